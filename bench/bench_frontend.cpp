@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <magic_enum.hpp>
+
+#include "AST.hpp"
+#include "Allocation.hpp"
+#include "Lexer.hpp"
+#include "Scan.hpp"
+
+#include "logging.hpp"
+
+class GeneratorOptions {
+public:
+    // Shape of the synthetic source
+    size_t size              = 1 << 20; // Bytes
+    size_t identifier_length = 8;
+    double comment_density   = 0.2; // Fraction of lines that are comments
+    size_t operator_density  = 4; // Binary operators per statement
+    size_t nesting           = 3; // Depth of array<array<...>> in declarations
+    size_t seed              = 1;
+};
+
+std::string nested_type(size_t depth) {
+    std::string type = "i32";
+    for(size_t d = 0; d < depth; d++) {
+        type = "array<" + type + ">";
+    }
+    return type;
+}
+
+std::string generate_source(const GeneratorOptions& options) {
+    // Functions of declarations and comments, deterministic for a given seed
+    std::mt19937                     random(static_cast<uint32_t>(options.seed));
+    std::uniform_real_distribution<> chance(0.0, 1.0);
+    const std::string                letters    = "abcdefghijklmnopqrstuvwxyz_";
+    const std::string                operators  = "+-*/%";
+    auto                             identifier = [&]() {
+        std::string name(1, letters[random() % 26]);
+        while(name.length() < options.identifier_length) {
+            name += letters[random() % letters.length()];
+        }
+        return name;
+    };
+
+    std::string type = nested_type(options.nesting);
+    std::string source;
+    source.reserve(options.size + 256);
+    size_t statement = 0;
+    while(source.length() < options.size) {
+        if(statement % 32 == 0) {
+            source += (statement == 0 ? "" : "}\n\n");
+            source += "func " + identifier() + "(" + identifier() + " : i32, " + identifier() +
+                      " : f64) -> i32 {\n";
+        }
+        statement++;
+        if(chance(random) < options.comment_density) {
+            source += "    # " + identifier() + " " + identifier() + " " + identifier() + "\n";
+            continue;
+        }
+        source += "    let " + identifier() + " : " + type + " = (" + identifier();
+        for(size_t o = 0; o < options.operator_density; o++) {
+            source += ' ';
+            source += operators[random() % operators.length()];
+            source += ' ';
+            source += (o % 2 == 0) ? std::to_string(random() % 1000) : identifier();
+        }
+        source += ");\n";
+    }
+    source += "}\n";
+    return source;
+}
+
+class Measurement {
+public:
+    std::string name;
+    size_t      bytes            = 0; // Input bytes processed by one run
+    size_t      tokens           = 0; // Tokens processed by one run
+    double      seconds          = 0; // Fastest run
+    size_t      allocations      = 0; // Made by one run
+    size_t      allocation_bytes = 0;
+    size_t      peak_bytes       = 0; // Most bytes one run had live at once, beyond what it found
+};
+
+template <typename Setup, typename Run>
+Measurement measure(const std::string& name, size_t iterations, Setup&& setup, Run&& run) {
+    // Setup happens outside of the timed region and its allocations are not counted
+    Measurement result;
+    result.name    = name;
+    result.seconds = std::numeric_limits<double>::max();
+    for(size_t i = 0; i < iterations; i++) {
+        auto            state  = setup();
+        AllocationStats before = AllocationTracker::total();
+        AllocationTracker::reset_peaks();
+        auto start = std::chrono::steady_clock::now();
+        run(state, result);
+        auto            end     = std::chrono::steady_clock::now();
+        double          seconds = std::chrono::duration<double>(end - start).count();
+        AllocationStats after   = AllocationTracker::total();
+        result.allocations      = after.count - before.count;
+        result.allocation_bytes = after.bytes - before.bytes;
+        result.peak_bytes       = after.peak - before.live;
+        result.seconds           = std::min(result.seconds, seconds);
+    }
+    return result;
+}
+
+void write_json(std::ostream&                   out,
+                const GeneratorOptions&         options,
+                size_t                          iterations,
+                const std::vector<Measurement>& results) {
+    out << "{\n";
+    out << "  \"version\": 1,\n";
+    out << "  \"scan_level\": \"" << magic_enum::enum_name(scan_level()) << "\",\n";
+    out << "  \"iterations\": " << iterations << ",\n";
+    out << "  \"generator\": {\"size\": " << options.size
+        << ", \"identifier_length\": " << options.identifier_length
+        << ", \"comment_density\": " << options.comment_density
+        << ", \"operator_density\": " << options.operator_density
+        << ", \"nesting\": " << options.nesting << ", \"seed\": " << options.seed << "},\n";
+    out << "  \"results\": [\n";
+    for(size_t i = 0; i < results.size(); i++) {
+        const Measurement& m = results[i];
+        out << "    {\"name\": \"" << m.name << "\", \"bytes\": " << m.bytes
+            << ", \"tokens\": " << m.tokens << ", \"seconds\": " << m.seconds
+            << ", \"tokens_per_second\": " << m.tokens / m.seconds
+            << ", \"mb_per_second\": " << m.bytes / m.seconds / 1e6
+            << ", \"allocations\": " << m.allocations
+            << ", \"allocated_bytes\": " << m.allocation_bytes
+            << ", \"peak_bytes\": " << m.peak_bytes << "}"
+            << (i + 1 == results.size() ? "\n" : ",\n");
+    }
+    out << "  ],\n";
+    // Everything the process allocated, by the phase probe it was made in
+    std::vector<AllocationStats> phases = AllocationTracker::phases();
+    out << "  \"allocation_phases\": [\n";
+    for(size_t i = 0; i < phases.size(); i++) {
+        const AllocationStats& phase = phases[i];
+        out << "    {\"phase\": \"" << phase.phase << "\", \"allocations\": " << phase.count
+            << ", \"allocated_bytes\": " << phase.bytes << ", \"peak_bytes\": " << phase.peak
+            << "}" << (i + 1 == phases.size() ? "\n" : ",\n");
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+int main(int argc, char** argv) {
+    CLI::App         app{"Raj front-end benchmark"};
+    GeneratorOptions options;
+    size_t           iterations   = 5;
+    size_t           type_repeats = 10000;
+    std::string      output       = "-";
+    std::string      dump;
+    app.add_option("--size", options.size, "Bytes of generated source");
+    app.add_option("--identifier-length", options.identifier_length, "Characters per identifier");
+    app.add_option(
+        "--comment-density", options.comment_density, "Fraction of lines that are comments");
+    app.add_option(
+        "--operator-density", options.operator_density, "Binary operators per statement");
+    app.add_option("--nesting", options.nesting, "Depth of array<array<...>> types");
+    app.add_option("--seed", options.seed, "Seed of the generator");
+    app.add_option("--iterations", iterations, "Runs of each measurement, the fastest is kept");
+    app.add_option("--type-repeats", type_repeats, "parse_type calls per run");
+    app.add_option("-o,--output", output, "JSON results, - for stdout");
+    app.add_option("--dump", dump, "Also write the generated source here");
+    CLI11_PARSE(app, argc, argv);
+
+    // Every allocation is counted, towards the phase it was made in
+    AllocationTracker::enable();
+    std::pmr::set_default_resource(AllocationTracker::resource());
+
+    // The measured code logs, keep it off the console so only the JSON is printed
+    std::ostream discard(nullptr);
+    currentLogCapture = &discard;
+
+    SourceCode source("bench.raj", generate_source(options));
+    if(!dump.empty()) {
+        std::ofstream(dump) << source.raw_document;
+    }
+    const size_t bytes = source.raw_document.length();
+
+    std::vector<Measurement> results;
+    results.push_back(measure(
+        "lex_file",
+        iterations,
+        []() { return 0; },
+        [&](int, Measurement& m) {
+            TokenBuffer lexemes = lex_file(source);
+            m.bytes             = bytes;
+            m.tokens            = lexemes.size();
+        }));
+    results.push_back(measure(
+        "lex_file_keep_spaces",
+        iterations,
+        []() { return 0; },
+        [&](int, Measurement& m) {
+            TokenBuffer lexemes = lex_file(source, true);
+            m.bytes             = bytes;
+            m.tokens            = lexemes.size();
+        }));
+    results.push_back(measure(
+        "filter_spaces",
+        iterations,
+        [&]() { return lex_file(source, true); },
+        [&](TokenBuffer& lexemes, Measurement& m) {
+            m.bytes  = bytes;
+            m.tokens = lexemes.size();
+            filter_spaces(lexemes);
+        }));
+
+    SourceCode  type_source("bench_type.raj", nested_type(options.nesting));
+    TokenBuffer type_lexemes = lex_file(type_source);
+    results.push_back(measure(
+        "parse_type",
+        iterations,
+        []() { return 0; },
+        [&](int, Measurement& m) {
+            // Every repeat after the first finds the type already interned
+            for(size_t r = 0; r < type_repeats; r++) {
+                TokenStream stream(type_lexemes);
+                TypeId      parsed = parse_type(stream);
+                (void)parsed;
+            }
+            m.bytes  = type_source.raw_document.length() * type_repeats;
+            m.tokens = type_lexemes.size() * type_repeats;
+        }));
+
+    currentLogCapture = nullptr;
+    if(output == "-") {
+        write_json(std::cout, options, iterations, results);
+    }
+    else {
+        std::ofstream out(output);
+        write_json(out, options, iterations, results);
+    }
+    return 0;
+}
@@ -1 +1 @@
-cmake ./ && make && echo -e "\e[32m ------- Compile Succeeded ------- \e[0m \n\n" && ./raj
\ No newline at end of file
+cmake ./ && make && echo -e "\e[32m ------- Compile Succeeded ------- \e[0m \n\n" && ./raj examples/function_calling.raj
\ No newline at end of file
@@ -1,37 +1,44 @@
 #include "AST.hpp"
+#include "Diagnostics.hpp"
 #include "Lexer.hpp"
+#include "Profile.hpp"
+#include "Resolve.hpp"
 #include "logging.hpp"
-#include <boost/assert/source_location.hpp>
-#include <boost/graph/detail/adjacency_list.hpp>
-#include <boost/graph/subgraph.hpp>
+#include <algorithm>
+#include <cassert>
+#include <optional>
 #include <stack>
 #include <tuple>
+#include <unordered_set>
 #include <vector>
 
 ASTNode::ASTNode() {
     this->node_class = ASTNodeClass::Root;
+    this->sub_type   = ASTNodeSubType::none;
     this->name       = "NULL";
+    this->type       = no_type;
+    this->symbol     = no_symbol;
     this->location   = Location();
-    this->_color     = "white";
 }
 
-ASTNode::ASTNode(ASTNodeClass    type,
-                 ASTNodeSubType  subtype,
-                 std::string     name,
-                 const Location& location) {
+ASTNode::ASTNode(ASTNodeClass     type,
+                 ASTNodeSubType   subtype,
+                 std::string_view name,
+                 const Location&  location,
+                 Symbol           symbol) {
     this->node_class = type;
     this->sub_type   = subtype;
-    this->name       = std::move(name);
+    this->name       = name;
+    this->type       = no_type;
+    this->symbol     = symbol;
     this->location   = location;
-    this->_color     = _get_graph_color();
-    this->_shape     = _get_graph_shape();
 }
 
-std::string ASTNode::_get_graph_color() const {
+const char* ASTNode::_get_graph_color() const {
     // Pick some random light colors
     switch(this->node_class) {
     case ASTNodeClass::Root:
-        return "#000000";
+        return "white";
     case ASTNodeClass::Function:
         return "#84B6FF";
     case ASTNodeClass::Declaration:
@@ -43,12 +50,20 @@ std::string ASTNode::_get_graph_color() const {
     case ASTNodeClass::Type:
         return "#47dfb9";
     case ASTNodeClass::Return:
+    case ASTNodeClass::ReturnStatement:
         return "#b9e2b9";
+    case ASTNodeClass::Identifier:
+    case ASTNodeClass::Literal:
+        return "#f2f2a0";
+    case ASTNodeClass::Call:
+    case ASTNodeClass::Cast:
+    case ASTNodeClass::List:
+        return "#ffcf9e";
     }
     return "white";
 }
 
-std::string ASTNode::_get_graph_shape() const {
+const char* ASTNode::_get_graph_shape() const {
     // Pick some shapes
     switch(this->node_class) {
     case ASTNodeClass::Root:
@@ -64,17 +79,208 @@ std::string ASTNode::_get_graph_shape() const {
     case ASTNodeClass::Type:
         return "invhouse";
     case ASTNodeClass::Return:
+    case ASTNodeClass::ReturnStatement:
         return "rarrow";
+    case ASTNodeClass::Identifier:
+    case ASTNodeClass::Literal:
+        return "oval";
+    case ASTNodeClass::Call:
+    case ASTNodeClass::Cast:
+    case ASTNodeClass::List:
+        return "rect";
     }
     return "ellipse";
 }
 ASTNode::~ASTNode() = default;
 
-std::tuple<Tree, vertex_t> parse_type(std::vector<std::tuple<Lexeme, Location>>& type_lexemes,
-                                      std::stack<vertex_t>&                      type_stack,
-                                      Tree&                                      type_tree,
-                                      Location                                   root_location) {
-    /// returns type tree and reference to root node
+Tree::Tree() {
+    this->arena = std::make_shared<Arena>();
+}
+
+Tree::~Tree() = default;
+
+vertex_t Tree::add_vertex(const ASTNode& node) {
+    auto vertex = static_cast<vertex_t>(this->nodes.size());
+    this->nodes.push_back(node);
+    this->parents.push_back(no_vertex);
+    this->first_children.push_back(no_vertex);
+    this->last_children.push_back(no_vertex);
+    this->next_siblings.push_back(no_vertex);
+    this->declarations.push_back(no_vertex);
+    return vertex;
+}
+
+void Tree::add_edge(vertex_t parent, vertex_t child) {
+    if(parent == child) {
+        // A node is never its own child
+        return;
+    }
+    // The parser attaches every node it creates exactly once
+    assert(this->parents[child] == no_vertex && "AST node attached to two parents");
+    this->parents[child] = parent;
+    if(this->last_children[parent] == no_vertex) {
+        this->first_children[parent] = child;
+    }
+    else {
+        this->next_siblings[this->last_children[parent]] = child;
+    }
+    this->last_children[parent] = child;
+}
+
+void Tree::truncate(size_t size) {
+    // Vertices are only added, so the children a remaining vertex gained from size on are the tail
+    // of its child list
+    for(size_t vertex = size; vertex < this->nodes.size(); vertex++) {
+        vertex_t parent = this->parents[vertex];
+        if(parent == no_vertex || parent >= size) {
+            continue;
+        }
+        vertex_t last = no_vertex;
+        for(vertex_t child = this->first_children[parent]; child != no_vertex && child < size;
+            child          = this->next_siblings[child]) {
+            last = child;
+        }
+        if(last == no_vertex) {
+            this->first_children[parent] = no_vertex;
+        }
+        else {
+            this->next_siblings[last] = no_vertex;
+        }
+        this->last_children[parent] = last;
+    }
+    this->nodes.resize(size);
+    this->parents.resize(size);
+    this->first_children.resize(size);
+    this->last_children.resize(size);
+    this->next_siblings.resize(size);
+    this->declarations.resize(size);
+    for(auto unparsed = this->unparsed_bodies.begin(); unparsed != this->unparsed_bodies.end();) {
+        unparsed = unparsed->first >= size ? this->unparsed_bodies.erase(unparsed) : ++unparsed;
+    }
+}
+
+size_t Tree::size() const {
+    return this->nodes.size();
+}
+
+ASTNode& Tree::operator[](vertex_t vertex) {
+    return this->nodes[vertex];
+}
+
+const ASTNode& Tree::operator[](vertex_t vertex) const {
+    return this->nodes[vertex];
+}
+
+vertex_t Tree::parent(vertex_t vertex) const {
+    return this->parents[vertex];
+}
+
+vertex_t Tree::first_child(vertex_t vertex) const {
+    return this->first_children[vertex];
+}
+
+vertex_t Tree::next_sibling(vertex_t vertex) const {
+    return this->next_siblings[vertex];
+}
+
+vertex_t Tree::declaration(vertex_t vertex) const {
+    return this->declarations[vertex];
+}
+
+bool Tree::body_parsed(vertex_t function) const {
+    return this->unparsed_bodies.count(function) == 0;
+}
+
+void Tree::bind(vertex_t use, vertex_t declaration) {
+    this->declarations[use] = declaration;
+}
+
+boost::integer_range<vertex_t> Tree::vertex_set() const {
+    return boost::irange<vertex_t>(0, static_cast<vertex_t>(this->nodes.size()));
+}
+
+std::string_view Tree::store(std::string_view text) {
+    return this->arena->store(text);
+}
+
+namespace {
+
+template <typename... Parts>
+void report_unexpected(TokenStream& lexemes, const Parts&... expected) {
+    // The lexeme at the cursor is not what the parser expected, it is left for recovery
+    Lexeme lexeme = lexemes.peek();
+    report_error(lexemes.location(),
+                 "Expected ",
+                 expected...,
+                 ", received ",
+                 lexeme.tokens,
+                 " of type ",
+                 ename(lexeme.lexeme_type));
+}
+
+// Levels of statements, expressions and types the parser of this thread is inside
+thread_local size_t nesting_depth = 0;
+
+class Nesting {
+public:
+    // One level deeper for the life of the scope
+    Nesting() {
+        nesting_depth++;
+    }
+    Nesting(const Nesting&)            = delete;
+    Nesting& operator=(const Nesting&) = delete;
+    ~Nesting() {
+        nesting_depth--;
+    }
+
+    // Reported at the first level past max_nesting, the levels above only unwind
+    [[nodiscard]] bool too_deep(TokenStream& lexemes) const {
+        if(nesting_depth <= max_nesting) {
+            return false;
+        }
+        report_error(lexemes.location(), "Nested more than ", max_nesting, " levels deep");
+        return true;
+    }
+};
+
+std::optional<Lexeme> expect(TokenStream& lexemes, LexemeClass expected, const char* context) {
+    // Consume the next lexeme if it is of the expected class, anything else is reported
+    if(lexemes.peek_kind() != expected) {
+        report_unexpected(lexemes, ename(expected), " ", context);
+        return std::nullopt;
+    }
+    return lexemes.next();
+}
+
+std::optional<std::vector<TypeId>> parse_type_list(TokenStream& lexemes, LexemeClass closing) {
+    // Comma separated types up to and including the closing lexeme, which may follow directly
+    std::vector<TypeId> types;
+    if(lexemes.peek_kind() == closing) {
+        lexemes.next();
+        return types;
+    }
+    while(true) {
+        TypeId type = parse_type(lexemes);
+        if(type == no_type) {
+            return std::nullopt;
+        }
+        types.push_back(type);
+        LexemeClass separator = lexemes.peek_kind();
+        if(separator == closing) {
+            lexemes.next();
+            return types;
+        }
+        if(separator != LexemeClass::Comma) {
+            report_unexpected(lexemes, "Comma or ", ename(closing), " in type list");
+            return std::nullopt;
+        }
+        lexemes.next();
+    }
+}
+
+} // namespace
+
+TypeId parse_type(TokenStream& lexemes) {
     /// Expecting a sequence of lexemes that look like any of the following examples:
     // i32
     // f64
@@ -86,409 +292,822 @@ std::tuple<Tree, vertex_t> parse_type(std::vector<std::tuple<Lexeme, Location>>&
     // (array<i32>, map<i32, i32>)
     // func<i32, f32> -> f32
     // func<i32, f32> -> (i32, f32)
+    // Each form is told apart by its first lexeme, so this is a plain recursive descent that reads
+    // the tokens in place and returns interned types, equal types come back as the same TypeId.
+    Nesting nesting;
+    if(nesting.too_deep(lexemes)) {
+        return no_type;
+    }
+    TypeTable& types = TypeTable::current();
+    Lexeme     lexeme = lexemes.peek();
+    switch(lexeme.lexeme_type) {
+    case LexemeClass::FloatType:
+    case LexemeClass::IntegerType:
+    case LexemeClass::UIntegerType:
+        // The sub type comes straight from the shared keyword table
+        lexemes.next();
+        return types.primitive(keyword_sub_type(lexeme.tokens));
+    case LexemeClass::Array: {
+        lexemes.next();
+        if(!expect(lexemes, LexemeClass::ABrackL, "after 'array'")) {
+            return no_type;
+        }
+        TypeId element = parse_type(lexemes);
+        if(element == no_type ||
+           !expect(lexemes, LexemeClass::ABrackR, "after the element type of an array")) {
+            return no_type;
+        }
+        return types.array(element);
+    }
+    case LexemeClass::Map: {
+        lexemes.next();
+        if(!expect(lexemes, LexemeClass::ABrackL, "after 'map'")) {
+            return no_type;
+        }
+        TypeId key = parse_type(lexemes);
+        if(key == no_type || !expect(lexemes, LexemeClass::Comma, "after the key type of a map")) {
+            return no_type;
+        }
+        TypeId value = parse_type(lexemes);
+        if(value == no_type ||
+           !expect(lexemes, LexemeClass::ABrackR, "after the value type of a map")) {
+            return no_type;
+        }
+        return types.map(key, value);
+    }
+    case LexemeClass::Function: {
+        lexemes.next();
+        if(!expect(lexemes, LexemeClass::ABrackL, "after 'func'")) {
+            return no_type;
+        }
+        std::optional<std::vector<TypeId>> parameters =
+            parse_type_list(lexemes, LexemeClass::ABrackR);
+        if(!parameters ||
+           !expect(lexemes, LexemeClass::RightArrow, "after the parameter types of a func")) {
+            return no_type;
+        }
+        TypeId result = parse_type(lexemes);
+        return result == no_type ? no_type : types.func(*parameters, result);
+    }
+    case LexemeClass::ParenL: {
+        lexemes.next();
+        std::optional<std::vector<TypeId>> elements = parse_type_list(lexemes, LexemeClass::ParenR);
+        return elements ? types.tuple(*elements) : no_type;
+    }
+    default:
+        report_unexpected(lexemes, "a type");
+        return no_type;
+    }
+}
 
-    LOG_DEBUG("Calling Parse_type " << ename(std::get<0>(type_lexemes[0]).lexeme_type))
-    for(size_t i = 0; i < type_lexemes.size(); i++) {
-        Lexeme   lexeme = std::get<0>(type_lexemes[i]);
-        Location loc    = std::get<1>(type_lexemes[i]);
-        LOG_INFO("  0> Adding " << ename(lexeme.lexeme_type) << " tokens " << lexeme.tokens)
-        if(lexeme.lexeme_type == LexemeClass::ParenL) {
-            // push to stack
-            vertex_t tuple_type              = boost::add_vertex(type_tree);
-            type_tree[tuple_type].name       = lexeme.tokens;
-            type_tree[tuple_type].node_class = ASTNodeClass::Type;
-            type_tree[tuple_type].sub_type   = ASTNodeSubType::tuple;
-            type_tree[tuple_type].location   = loc;
-            type_stack.push(tuple_type);
-        }
-        else if(lexeme.lexeme_type == LexemeClass::ParenR) {
-            // pop from stack
-            type_stack.pop();
-        }
-        else if(lexeme.lexeme_type == LexemeClass::FloatType) {
-            // Add child
-            vertex_t float_type = boost::add_vertex(type_tree);
-            if(lexeme.tokens == "f32") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::f32;
-            }
-            else if(lexeme.tokens == "f64") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::f64;
-            }
-            type_tree[float_type].name       = lexeme.tokens;
-            type_tree[float_type].node_class = ASTNodeClass::Type;
-            type_tree[float_type].location   = loc;
-            if(!type_stack.empty()) {
-                boost::add_edge(type_stack.top(), float_type, type_tree);
-            }
-            else {
-                type_stack.push(float_type);
-            }
+vertex_t add_type_nodes(Tree& tree, TypeId type, const Location& location) {
+    TypeTable&     types = TypeTable::current();
+    ASTNodeSubType kind  = types.kind(type);
+    vertex_t       node  = tree.add_vertex(
+        ASTNode(ASTNodeClass::Type, kind, TypeTable::kind_name(kind), location));
+    tree[node].type = type;
+    for(TypeId operand : types.operands(type)) {
+        tree.add_edge(node, add_type_nodes(tree, operand, location));
+    }
+    return node;
+}
+
+std::tuple<Tree, vertex_t> parse_type(const TokenBuffer& type_lexemes, Location root_location) {
+    /// returns type tree and reference to root node
+    TokenStream stream(type_lexemes);
+    TypeId      type = parse_type(stream);
+    if(type == no_type) {
+        return {Tree(), no_vertex};
+    }
+    if(!stream.at_end()) {
+        report_error(stream.location(), "Unexpected ", stream.peek().tokens, " after the type");
+        return {Tree(), no_vertex};
+    }
+    Tree     tree;
+    vertex_t root = add_type_nodes(tree, type, root_location);
+    return {std::move(tree), root};
+}
+
+// The parser is a single pass of recursive descent over the token stream, with precedence climbing
+// (Pratt parsing) for expressions. Each function consumes exactly the tokens of what it parses and
+// returns the node it built, so every token is looked at a bounded number of times. Errors never
+// throw, a function that meets one reports it and returns no_vertex, no_type or false, and the
+// enclosing block removes what the statement added to the tree and skips the rest of it.
+vertex_t ast_gen_function(Tree& ast, TokenStream& lexemes, bool lazy_body = false);
+void     ast_gen_block(Tree& ast, vertex_t scope, TokenStream& lexemes);
+vertex_t ast_gen_expression(Tree& ast, TokenStream& lexemes, int min_power = 0);
+
+namespace {
+
+class BindingPower {
+public:
+    int left; // How strongly an operator holds on to the expression before it, 0 if it cannot
+    int right; // Minimum power of the expression after it
+};
+
+// e.g. -x binds tighter than x * y and x as f32, but not as tight as a call
+constexpr int prefix_power = 40;
+
+BindingPower infix_power(const Lexeme& lexeme) {
+    switch(lexeme.lexeme_type) {
+    case LexemeClass::Assignment:
+        return {2, 1}; // Right associative
+    case LexemeClass::MathExpression:
+        if(lexeme.tokens == "+" || lexeme.tokens == "-") {
+            return {10, 11};
         }
-        else if(lexeme.lexeme_type == LexemeClass::IntegerType) {
-            // Add child
-            LOG_DEBUG("Parse Int")
-            LOG_DEBUG(" " << ename(type_tree[type_stack.top()].sub_type))
-            LOG_DEBUG(" " << ename(type_tree[type_stack.top()].node_class))
-            vertex_t integer_type = boost::add_vertex(type_tree);
-            if(lexeme.tokens == "i8") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::i8;
-            }
-            else if(lexeme.tokens == "i16") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::i16;
-            }
-            else if(lexeme.tokens == "i32") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::i32;
-            }
-            else if(lexeme.tokens == "i64") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::i64;
-            }
-            else if(lexeme.tokens == "i128") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::i128;
-            }
-            type_tree[integer_type].name       = lexeme.tokens;
-            type_tree[integer_type].node_class = ASTNodeClass::Type;
-            type_tree[integer_type].location   = loc;
-            if(!type_stack.empty()) {
-                boost::add_edge(type_stack.top(), integer_type, type_tree);
+        return {20, 21}; // * / %
+    case LexemeClass::Cast:
+        return {30, 0};
+    case LexemeClass::ParenL:
+        return {50, 0}; // Call
+    default:
+        return {0, 0};
+    }
+}
+
+std::optional<uint32_t> skip_braces(std::string_view source, const Location& open) {
+    // Offset just past the CurlR matching the one at open. Balancing braces over the raw text is
+    // far cheaper than lexing, a comment is the only token that can hold a brace.
+    uint32_t depth = 0;
+    for(size_t i = open.offset; i < source.length(); i++) {
+        char ch = source[i];
+        if(ch == '{') {
+            depth++;
+        }
+        else if(ch == '}' && --depth == 0) {
+            return static_cast<uint32_t>(i + 1);
+        }
+        else if(ch == '#') {
+            i = std::min(source.find('\n', i), source.length());
+        }
+    }
+    report_error(open, "Expected CurlR '}' to close the body opened");
+    return std::nullopt;
+}
+
+void synchronise(TokenStream& lexemes) {
+    // Panic mode recovery after a statement with an error: skip to just after the next ; or to
+    // just before the } closing the scope, or to the next statement keyword. Braces opened on the
+    // way are skipped as a whole, a block after the error ends the statement. Every token is
+    // skipped once, so a file with many errors is still parsed in one linear pass.
+    size_t depth = 0;
+    while(!lexemes.at_end()) {
+        LexemeClass kind = lexemes.peek_kind();
+        if(depth == 0) {
+            if(kind == LexemeClass::CurlR || kind == LexemeClass::Declaration ||
+               kind == LexemeClass::Return ||
+               (kind == LexemeClass::Function &&
+                lexemes.peek_kind(1) == LexemeClass::Identifier)) {
+                return;
             }
-            else {
-                type_stack.push(integer_type);
+            if(kind == LexemeClass::SemiColon) {
+                lexemes.next();
+                return;
             }
         }
-        else if(lexeme.lexeme_type == LexemeClass::UIntegerType) {
-            // Add child
-            vertex_t integer_type = boost::add_vertex(type_tree);
-            if(lexeme.tokens == "u8") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::u8;
-            }
-            else if(lexeme.tokens == "u16") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::u16;
+        lexemes.next();
+        if(kind == LexemeClass::CurlL) {
+            depth++;
+        }
+        else if(kind == LexemeClass::CurlR && --depth == 0) {
+            return;
+        }
+    }
+}
+
+std::string_view anonymous_name(Tree& ast, const Location& loc) {
+    // Scopes and functions without a name are named after where they start
+    std::string name = loc.file().filename().string() + "_" + std::to_string(loc.line()) +
+                       std::to_string(loc.column());
+    return ast.store(name);
+}
+
+bool ast_gen_elements(Tree& ast, vertex_t list, TokenStream& lexemes, LexemeClass closing) {
+    // Comma separated expressions up to and including the closing lexeme, which may follow directly
+    if(lexemes.peek_kind() == closing) {
+        lexemes.next();
+        return true;
+    }
+    while(true) {
+        vertex_t element = ast_gen_expression(ast, lexemes);
+        if(element == no_vertex) {
+            return false;
+        }
+        ast.add_edge(list, element);
+        LexemeClass separator = lexemes.peek_kind();
+        if(separator == closing) {
+            lexemes.next();
+            return true;
+        }
+        if(separator != LexemeClass::Comma) {
+            report_unexpected(lexemes, "Comma or ", ename(closing), " between elements");
+            return false;
+        }
+        lexemes.next();
+    }
+}
+
+vertex_t ast_gen_collection(Tree& ast, TokenStream& lexemes) {
+    // [1, 4, 66] is an array, [1 : 1, 4 : 16] a map, the first element decides which
+    Location loc = lexemes.location();
+    lexemes.next(); // SquareL
+    vertex_t list = ast.add_vertex(ASTNode(ASTNodeClass::List, ASTNodeSubType::array, "array", loc));
+    if(lexemes.peek_kind() == LexemeClass::SquareR) {
+        lexemes.next();
+        return list;
+    }
+    bool is_map = false;
+    for(size_t index = 0;; index++) {
+        vertex_t element = ast_gen_expression(ast, lexemes);
+        if(element == no_vertex) {
+            return no_vertex;
+        }
+        if(index == 0 && lexemes.peek_kind() == LexemeClass::Colon) {
+            is_map             = true;
+            ast[list].sub_type = ASTNodeSubType::map;
+            ast[list].name     = "map";
+        }
+        if(is_map) {
+            // Each entry is a : node of the key and the value
+            Location              colon_loc = lexemes.location();
+            std::optional<Lexeme> colon =
+                expect(lexemes, LexemeClass::Colon, "after the key of a map entry");
+            if(!colon) {
+                return no_vertex;
             }
-            else if(lexeme.tokens == "u32") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::u32;
+            vertex_t entry = ast.add_vertex(
+                ASTNode(ASTNodeClass::Expression, ASTNodeSubType::none, colon->tokens, colon_loc));
+            ast.add_edge(entry, element);
+            vertex_t value = ast_gen_expression(ast, lexemes);
+            if(value == no_vertex) {
+                return no_vertex;
             }
-            else if(lexeme.tokens == "u64") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::u64;
+            ast.add_edge(entry, value);
+            element = entry;
+        }
+        ast.add_edge(list, element);
+        LexemeClass separator = lexemes.peek_kind();
+        if(separator == LexemeClass::SquareR) {
+            lexemes.next();
+            return list;
+        }
+        if(separator != LexemeClass::Comma) {
+            report_unexpected(lexemes, "Comma or SquareR in ", ast[list].name, " literal");
+            return no_vertex;
+        }
+        lexemes.next();
+    }
+}
+
+vertex_t ast_gen_prefix(Tree& ast, TokenStream& lexemes) {
+    // The start of an expression: a name, literal, prefix operator, group, tuple, collection or
+    // anonymous function
+    Location loc    = lexemes.location();
+    Lexeme   lexeme = lexemes.peek();
+    switch(lexeme.lexeme_type) {
+    case LexemeClass::Identifier:
+        lexemes.next();
+        return ast.add_vertex(ASTNode(
+            ASTNodeClass::Identifier, ASTNodeSubType::none, lexeme.tokens, loc, lexeme.symbol));
+    case LexemeClass::IntegerLiteral:
+        lexemes.next();
+        return ast.add_vertex(
+            ASTNode(ASTNodeClass::Literal, ASTNodeSubType::i64, lexeme.tokens, loc));
+    case LexemeClass::FloatLiteral:
+        lexemes.next();
+        return ast.add_vertex(
+            ASTNode(ASTNodeClass::Literal, ASTNodeSubType::f64, lexeme.tokens, loc));
+    case LexemeClass::MathExpression:
+        if(lexeme.tokens == "-") {
+            lexemes.next();
+            vertex_t negation = ast.add_vertex(
+                ASTNode(ASTNodeClass::Expression, ASTNodeSubType::none, lexeme.tokens, loc));
+            vertex_t operand = ast_gen_expression(ast, lexemes, prefix_power);
+            if(operand == no_vertex) {
+                return no_vertex;
             }
-            else if(lexeme.tokens == "u128") {
-                type_tree[type_stack.top()].sub_type = ASTNodeSubType::u128;
+            ast.add_edge(negation, operand);
+            return negation;
+        }
+        break;
+    case LexemeClass::ParenL: {
+        // (x) only groups, () and (x, y) are tuples
+        lexemes.next();
+        vertex_t first = no_vertex;
+        if(lexemes.peek_kind() != LexemeClass::ParenR) {
+            first = ast_gen_expression(ast, lexemes);
+            if(first == no_vertex) {
+                return no_vertex;
             }
-            type_tree[integer_type].name       = lexeme.tokens;
-            type_tree[integer_type].node_class = ASTNodeClass::Type;
-            type_tree[integer_type].location   = loc;
-            if(!type_stack.empty()) {
-                boost::add_edge(type_stack.top(), integer_type, type_tree);
+            if(lexemes.peek_kind() == LexemeClass::ParenR) {
+                lexemes.next();
+                return first;
             }
-            else {
-                type_stack.push(integer_type);
+            if(!expect(lexemes, LexemeClass::Comma, "between the elements of a tuple")) {
+                return no_vertex;
             }
         }
-        else if(lexeme.lexeme_type == LexemeClass::Array) {
-            // Recursive call after <
-            vertex_t array_type              = boost::add_vertex(type_tree);
-            type_tree[array_type].name       = lexeme.tokens;
-            type_tree[array_type].node_class = ASTNodeClass::Type;
-            type_tree[array_type].sub_type   = ASTNodeSubType::array;
-            type_tree[array_type].location   = loc;
-            type_stack.push(array_type);
-            // assert that the next one is a <
-            if(std::get<0>(type_lexemes[i + 1]).lexeme_type != LexemeClass::ABrackL) {
-                throw BaseException(
-                    loc.file, loc.line, loc.column, "Token after 'array' is not '<'");
+        vertex_t tuple =
+            ast.add_vertex(ASTNode(ASTNodeClass::List, ASTNodeSubType::tuple, "tuple", loc));
+        if(first != no_vertex) {
+            ast.add_edge(tuple, first);
+        }
+        if(!ast_gen_elements(ast, tuple, lexemes, LexemeClass::ParenR)) {
+            return no_vertex;
+        }
+        return tuple;
+    }
+    case LexemeClass::SquareL:
+        return ast_gen_collection(ast, lexemes);
+    case LexemeClass::Function:
+        return ast_gen_function(ast, lexemes);
+    default:
+        break;
+    }
+    report_unexpected(lexemes, "an expression");
+    return no_vertex;
+}
+
+bool ast_gen_declaration(Tree& ast, vertex_t scope, TokenStream& lexemes) {
+    // let name : type = expression;
+    // let (name, name) : (type, type) = expression;
+    Location loc = lexemes.location();
+    lexemes.next(); // Declaration
+
+    std::vector<std::pair<Lexeme, Location>> names;
+    bool destructuring = lexemes.peek_kind() == LexemeClass::ParenL;
+    if(destructuring) {
+        lexemes.next();
+    }
+    while(true) {
+        Location              name_loc = lexemes.location();
+        std::optional<Lexeme> name = expect(lexemes, LexemeClass::Identifier, "in declaration");
+        if(!name) {
+            return false;
+        }
+        names.emplace_back(*name, name_loc);
+        if(!destructuring || lexemes.peek_kind() != LexemeClass::Comma) {
+            break;
+        }
+        lexemes.next();
+    }
+    if(destructuring && !expect(lexemes, LexemeClass::ParenR, "after the declared names")) {
+        return false;
+    }
+    if(!expect(lexemes, LexemeClass::Colon, "after the declared name")) {
+        return false;
+    }
+    Location   type_loc = lexemes.location();
+    TypeId     type     = parse_type(lexemes);
+    TypeTable& types    = TypeTable::current();
+    if(type == no_type) {
+        return false;
+    }
+    std::vector<TypeId> elements = types.operands(type);
+    if(destructuring &&
+       (types.kind(type) != ASTNodeSubType::tuple || elements.size() != names.size())) {
+        report_error(type_loc,
+                     "Cannot destructure ",
+                     types.to_string(type),
+                     " into ",
+                     names.size(),
+                     " names");
+        return false;
+    }
+
+    vertex_t declaration = ast.add_vertex();
+    ast.add_edge(scope, declaration);
+    if(!destructuring) {
+        ast[declaration] =
+            ASTNode(ASTNodeClass::Declaration, types.kind(type), names[0].first.tokens, loc);
+        ast[declaration].symbol = names[0].first.symbol;
+    }
+    else {
+        // One declaration per name below the declaration of the whole tuple
+        std::string joined;
+        for(size_t i = 0; i < names.size(); i++) {
+            joined += (i == 0 ? "(" : ", ") + std::string(names[i].first.tokens);
+            vertex_t element = ast.add_vertex(ASTNode(ASTNodeClass::Declaration,
+                                                      types.kind(elements[i]),
+                                                      names[i].first.tokens,
+                                                      names[i].second,
+                                                      names[i].first.symbol));
+            ast[element].type = elements[i];
+            ast.add_edge(declaration, element);
+        }
+        ast[declaration] = ASTNode(
+            ASTNodeClass::Declaration, ASTNodeSubType::tuple, ast.store(joined + ")"), loc);
+    }
+    ast[declaration].type = type;
+
+    // The initial value is optional
+    if(lexemes.peek_kind() == LexemeClass::Assignment) {
+        lexemes.next();
+        vertex_t value = ast_gen_expression(ast, lexemes);
+        if(value == no_vertex) {
+            return false;
+        }
+        ast.add_edge(declaration, value);
+    }
+    return expect(lexemes, LexemeClass::SemiColon, "after declaration").has_value();
+}
+
+bool ast_gen_statement(Tree& ast, vertex_t scope, TokenStream& lexemes) {
+    // False once an error is reported, the caller skips what is left of the statement
+    Nesting nesting;
+    if(nesting.too_deep(lexemes)) {
+        return false;
+    }
+    Location loc    = lexemes.location();
+    Lexeme   lexeme = lexemes.peek();
+    switch(lexeme.lexeme_type) {
+    case LexemeClass::Declaration:
+        return ast_gen_declaration(ast, scope, lexemes);
+    case LexemeClass::Return: {
+        lexemes.next();
+        vertex_t statement = ast.add_vertex(
+            ASTNode(ASTNodeClass::ReturnStatement, ASTNodeSubType::none, lexeme.tokens, loc));
+        ast.add_edge(scope, statement);
+        if(lexemes.peek_kind() != LexemeClass::SemiColon) {
+            vertex_t value = ast_gen_expression(ast, lexemes);
+            if(value == no_vertex) {
+                return false;
             }
-            int matching_brack = 0; // Store the altitude of brackets, then return index
-            for(size_t h_i = i + 1; h_i < type_lexemes.size(); h_i++) {
-                LOG_DEBUG("    " << ename(std::get<0>(type_lexemes[h_i]).lexeme_type) << "\t"
-                                 << h_i)
-
-                if(std::get<0>(type_lexemes[h_i]).lexeme_type == LexemeClass::ABrackL) {
-                    matching_brack += 1;
-                }
-                else if(std::get<0>(type_lexemes[h_i]).lexeme_type == LexemeClass::ABrackR) {
-                    matching_brack -= 1;
-                }
-                if(matching_brack == 0) {
-                    matching_brack = h_i;
-                    break;
-                }
-                if(h_i == type_lexemes.size()) {
-                    throw BaseException(boost::source_location(), "Cannot find matching '>'");
-                }
+            ast.add_edge(statement, value);
+        }
+        return expect(lexemes, LexemeClass::SemiColon, "after return").has_value();
+    }
+    case LexemeClass::Function:
+        if(lexemes.peek_kind(1) == LexemeClass::Identifier) {
+            // Named functions are statements of their own, anonymous ones are expressions
+            vertex_t function = ast_gen_function(ast, lexemes);
+            if(function == no_vertex) {
+                return false;
             }
-            auto subtype = std::vector<std::tuple<Lexeme, Location>>(
-                type_lexemes.begin() + i + 1, type_lexemes.begin() + matching_brack + 1);
-            LOG_DEBUG("recursive call made for "
-                      << "[" << i + 1 << ", " << matching_brack << "]")
-            std::tuple<Tree, vertex_t> parsed_subtree =
-                parse_type(subtype, type_stack, type_tree, root_location);
-            i = matching_brack; // BEWARE: Skip to matching bracket after parsing
-            boost::add_edge(array_type, std::get<1>(parsed_subtree), type_tree);
-        }
-        else if(lexeme.lexeme_type == LexemeClass::Map) {
-            // TODO
-            // Recursive call after <
-        }
-        else if(lexeme.lexeme_type == LexemeClass::Function) {
-            // TODO
-            // Recursive call after <
-            // expect ->
-            // recursive call
-        }
-        else if(lexeme.lexeme_type == LexemeClass::ABrackL) {
-            // assume (map | array | func) are at top
-            if((!type_stack.empty()) &&
-               (type_tree[type_stack.top()].sub_type == ASTNodeSubType::map ||
-                type_tree[type_stack.top()].sub_type == ASTNodeSubType::func ||
-                type_tree[type_stack.top()].sub_type == ASTNodeSubType::array)) {
-                LOG_DEBUG("ABrackL Not empty stack and child of [map|func|array] type. "
-                          << ename(type_tree[type_stack.top()].sub_type))
+            ast.add_edge(scope, function);
+            return true;
+        }
+        break;
+    case LexemeClass::CurlL: {
+        lexemes.next();
+        vertex_t anonymous_scope = ast.add_vertex(ASTNode(
+            ASTNodeClass::Function, ASTNodeSubType::func, anonymous_name(ast, loc), loc));
+        ast.add_edge(scope, anonymous_scope);
+        ast_gen_block(ast, anonymous_scope, lexemes);
+        return true;
+    }
+    case LexemeClass::SemiColon:
+        lexemes.next();
+        return true;
+    case LexemeClass::Conditional:
+        report_error(loc, "NOT IMPLEMENTED: Conditionals");
+        return false;
+    default:
+        break;
+    }
+    vertex_t expression = ast_gen_expression(ast, lexemes);
+    if(expression == no_vertex) {
+        return false;
+    }
+    ast.add_edge(scope, expression);
+    return expect(lexemes, LexemeClass::SemiColon, "after expression").has_value();
+}
+
+} // namespace
+
+vertex_t ast_gen_expression(Tree& ast, TokenStream& lexemes, int min_power) {
+    // Operators are folded into the expression on their left for as long as they bind at least
+    // as tightly as min_power, so a + b * c nests the multiplication below the addition
+    Nesting nesting;
+    if(nesting.too_deep(lexemes)) {
+        return no_vertex;
+    }
+    vertex_t left = ast_gen_prefix(ast, lexemes);
+    while(left != no_vertex) {
+        Lexeme       lexeme = lexemes.peek();
+        BindingPower power  = infix_power(lexeme);
+        if(power.left == 0 || power.left < min_power) {
+            return left;
+        }
+        Location loc = lexemes.location();
+        lexemes.next();
+        vertex_t node;
+        if(lexeme.lexeme_type == LexemeClass::Cast) {
+            TypeId type = parse_type(lexemes);
+            if(type == no_type) {
+                return no_vertex;
             }
-            else {
-                LOG_DEBUG("ABrackL start of AnonTupleTupe! " << i)
-                vertex_t tuple              = boost::add_vertex(type_tree);
-                type_tree[tuple].name       = "AnonTypeTuple";
-                type_tree[tuple].node_class = ASTNodeClass::Type;
-                type_tree[tuple].sub_type   = ASTNodeSubType::tuple;
-                type_tree[tuple].location   = loc;
-
-                type_stack.push(tuple);
+            std::string name = "as " + TypeTable::current().to_string(type);
+            node             = ast.add_vertex(ASTNode(
+                ASTNodeClass::Cast, TypeTable::current().kind(type), ast.store(name), loc));
+            ast[node].type = type;
+            ast.add_edge(node, left);
+        }
+        else if(lexeme.lexeme_type == LexemeClass::ParenL) {
+            // Calls of a name are named and keyed by it
+            bool named = ast[left].node_class == ASTNodeClass::Identifier;
+            node       = ast.add_vertex(ASTNode(ASTNodeClass::Call,
+                                                ASTNodeSubType::none,
+                                                named ? ast[left].name : "call",
+                                                loc,
+                                                named ? ast[left].symbol : no_symbol));
+            ast.add_edge(node, left);
+            if(!ast_gen_elements(ast, node, lexemes, LexemeClass::ParenR)) {
+                return no_vertex;
             }
-            // top = ASTNode(ASTNodeClass::Type, ASTNodeSubType::none, "Anon Tuple", loc);
         }
-        else if(lexeme.lexeme_type == LexemeClass::Comma) {
-            // Do nothing
+        else {
+            node = ast.add_vertex(
+                ASTNode(ASTNodeClass::Expression, ASTNodeSubType::none, lexeme.tokens, loc));
+            ast.add_edge(node, left);
+            vertex_t right = ast_gen_expression(ast, lexemes, power.right);
+            if(right == no_vertex) {
+                return no_vertex;
+            }
+            ast.add_edge(node, right);
         }
+        left = node;
     }
+    return no_vertex;
+}
 
-    return std::tuple(type_tree, type_stack.top());
+void ast_gen_block(Tree& ast, vertex_t scope, TokenStream& lexemes) {
+    // Statements up to and including the CurlR closing the scope, the CurlL is already consumed. A
+    // statement with an error is skipped and the block carries on with the next one.
+    while(lexemes.peek_kind() != LexemeClass::CurlR) {
+        if(lexemes.at_end()) {
+            report_error(ast[scope].location,
+                         "Expected CurlR '}' before the end of the file to close ",
+                         ast[scope].name);
+            return;
+        }
+        if(error_limit_reached()) {
+            return;
+        }
+        size_t statement_start = ast.size();
+        if(!ast_gen_statement(ast, scope, lexemes)) {
+            ast.truncate(statement_start);
+            synchronise(lexemes);
+        }
+    }
+    lexemes.next(); // CurlR
 }
 
-[[nodiscard]] size_t ast_gen_function(Tree&                                      ast,
-                                      std::stack<Tree::vertex_descriptor>&       scope_stack,
-                                      std::vector<std::tuple<Lexeme, Location>>& lexemes,
-                                      size_t                                     x) {
-    // Consume the following tokens that we expect
-    // Identifier
+vertex_t ast_gen_function(Tree& ast, TokenStream& lexemes, bool lazy_body) {
+    // Consume the following tokens that we expect, the Function lexeme is at the cursor
+    // Identifier, absent for anonymous functions
     // ParenL
     // Arbitrary number of arguments and types separated by Commas
     // ParenR
-    // RightArrow
-    // CurlL
-
-    Lexeme   lexeme = std::get<0>(lexemes[x]);
-    Location loc    = std::get<1>(lexemes[x]);
-
-    Tree::vertex_descriptor function_node = boost::add_vertex(ast);
-
-    Lexeme expecting_identifier = std::get<0>(lexemes[x + 1]);
-    if(expecting_identifier.lexeme_type != LexemeClass::Identifier) {
-        LOG_ERROR("Expected Identifier in argument, received "
-                  << expecting_identifier.tokens << " of type "
-                  << ename(expecting_identifier.lexeme_type) << " at "
-                  << std::get<1>(lexemes[x + 1]))
-        throw std::runtime_error("Received unexpected lexeme"); // Could generate something random?
-    }
-    boost::add_edge(scope_stack.top(), function_node, ast);
-    ast[function_node] =
-        ASTNode(ASTNodeClass::Function, ASTNodeSubType::func, expecting_identifier.tokens, loc);
-
-    Lexeme expecting_parenL = std::get<0>(lexemes[x + 2]);
-    if(expecting_parenL.lexeme_type != LexemeClass::ParenL) {
-        LOG_ERROR("Expected ParenL in argument, received " << expecting_parenL.tokens << " of type "
-                                                           << ename(expecting_parenL.lexeme_type)
-                                                           << " at " << std::get<1>(lexemes[x + 2]))
-        throw std::runtime_error("Received unexpected lexeme");
-    }
-
-    // Find out the number of arguments
-    // start is parenL
-    auto location_parenR = std::find_if(
-        lexemes.begin() + x + 3, lexemes.end(), [](const std::tuple<Lexeme, Location>& x) {
-            return std::get<0>(x).lexeme_type == LexemeClass::ParenR;
-        });
-    if(location_parenR == lexemes.end()) {
-        LOG_ERROR("Expected ParenR ')' for function after arguments "
-                  << expecting_identifier.tokens << " at location " << std::get<1>(lexemes[x + 1]))
-        throw std::runtime_error("Received unexpected lexeme");
-    }
-    size_t index_parenR = location_parenR - lexemes.begin();
-    // Parse arguments
-    std::vector<std::tuple<Lexeme, Lexeme, Lexeme>> arguments;
-    for(size_t p = x + 3; p < index_parenR; p = p) {
-        // Expect the structure of the arguments
-        // Identifier
-        // Colon
-        // Type
-        // Comma
-        Lexeme expecting_identifier_arg = std::get<0>(lexemes[p]);
-        if(expecting_identifier_arg.lexeme_type != LexemeClass::Identifier) {
-            LOG_ERROR("Expected Identifier in argument, received "
-                      << expecting_identifier_arg.tokens << " of type "
-                      << ename(expecting_identifier_arg.lexeme_type) << " at "
-                      << std::get<1>(lexemes[p]))
-            throw std::runtime_error("Received unexpected lexeme");
-        }
-        Lexeme expecting_colon = std::get<0>(lexemes[p + 1]);
-        if(expecting_colon.lexeme_type != LexemeClass::Colon) {
-            LOG_ERROR("Expected Colon in argument, received "
-                      << expecting_colon.tokens << " of type " << ename(expecting_colon.lexeme_type)
-                      << " at " << std::get<1>(lexemes[p + 1]))
-            throw std::runtime_error("Received unexpected lexeme");
-        }
-        Lexeme expecting_type = std::get<0>(lexemes[p + 2]);
-        // TODO:: This type checking will need to be much better
-        if(expecting_type.lexeme_type != LexemeClass::FloatType &&
-           expecting_type.lexeme_type != LexemeClass::IntegerType &&
-           expecting_type.lexeme_type != LexemeClass::UIntegerType) {
-            LOG_ERROR("Expected Type in argument, received "
-                      << expecting_type.tokens << " of type " << ename(expecting_type.lexeme_type)
-                      << " at " << std::get<1>(lexemes[p + 2]))
-            throw std::runtime_error("Received unexpected lexeme");
-        }
-        // Can expect comma or ParenR
-        Lexeme expecting_comma = std::get<0>(lexemes[p + 3]);
-        if(expecting_comma.lexeme_type != LexemeClass::Comma && p + 3 != index_parenR) {
-            LOG_ERROR("Expected Comma in argument, received "
-                      << expecting_comma.tokens << " of type " << ename(expecting_comma.lexeme_type)
-                      << " at " << std::get<1>(lexemes[p + 3]))
-            throw std::runtime_error("Received unexpected lexeme");
-        }
-        arguments.emplace_back(expecting_identifier_arg, expecting_colon, expecting_type);
-        p += 4;
+    // RightArrow and the return type, absent for void functions
+    // CurlL, the body and CurlR
+    // An error in the signature makes the whole function no_vertex, one in the body only skips
+    // the statement it is in.
+
+    Location loc = lexemes.location();
+    lexemes.next(); // Function
+
+    vertex_t         function_node = ast.add_vertex();
+    std::string_view name;
+    Symbol           symbol = no_symbol;
+    if(lexemes.peek_kind() == LexemeClass::Identifier) {
+        Lexeme identifier = lexemes.next();
+        name              = identifier.tokens;
+        symbol            = identifier.symbol;
+    }
+    else {
+        name = anonymous_name(ast, loc);
+    }
+    ast[function_node] = ASTNode(ASTNodeClass::Function, ASTNodeSubType::func, name, loc, symbol);
+
+    if(!expect(lexemes, LexemeClass::ParenL, "after function name")) {
+        return no_vertex;
+    }
+
+    // Parse arguments until the ParenR
+    // Expect the structure of the arguments
+    // Identifier
+    // Colon
+    // Type
+    // Comma or ParenR
+    std::vector<std::tuple<Lexeme, TypeId, Location>> arguments;
+    while(lexemes.peek_kind() != LexemeClass::ParenR) {
+        if(lexemes.at_end()) {
+            report_error(lexemes.location(), "Expected ParenR ')' after the arguments of ", name);
+            return no_vertex;
+        }
+        Location              argument_loc = lexemes.location();
+        std::optional<Lexeme> argument = expect(lexemes, LexemeClass::Identifier, "in argument");
+        if(!argument || !expect(lexemes, LexemeClass::Colon, "in argument")) {
+            return no_vertex;
+        }
+        TypeId type = parse_type(lexemes);
+        if(type == no_type) {
+            return no_vertex;
+        }
+        arguments.emplace_back(*argument, type, argument_loc);
+        // The comma is consumed, a ParenR is left to end the loop
+        if(lexemes.peek_kind() == LexemeClass::Comma) {
+            lexemes.next();
+        }
+        else if(lexemes.peek_kind() != LexemeClass::ParenR) {
+            report_unexpected(lexemes, "Comma or ParenR in argument");
+            return no_vertex;
+        }
     }
+    lexemes.next(); // ParenR
 
     // Write the arguments to the graph
-    for(auto arg : arguments) {
+    TypeTable& types = TypeTable::current();
+    for(const auto& [argument, type, argument_loc] : arguments) {
         // Create the argument node
-        Tree::vertex_descriptor argument_node = boost::add_vertex(ast);
-        Tree::vertex_descriptor type_node     = boost::add_vertex(ast);
+        vertex_t    argument_node = ast.add_vertex();
+        vertex_t    type_node     = ast.add_vertex();
+        std::string type_name     = types.to_string(type);
         // Add the argument node to the function node
-        boost::add_edge(function_node, argument_node, ast);
-        boost::add_edge(argument_node, type_node, ast);
-        std::string arg_name  = std::get<0>(arg).tokens + " : " + std::get<2>(arg).tokens;
-        std::string type_name = std::get<2>(arg).tokens;
-        ast[argument_node] = ASTNode(ASTNodeClass::Argument, ASTNodeSubType::none, arg_name, loc);
-        ast[type_node]     = ASTNode(ASTNodeClass::Type, ASTNodeSubType::none, type_name, loc);
+        ast.add_edge(function_node, argument_node);
+        ast.add_edge(argument_node, type_node);
+        // The name is the identifier itself, the type is the child
+        ast[argument_node] = ASTNode(ASTNodeClass::Argument,
+                                     ASTNodeSubType::none,
+                                     argument.tokens,
+                                     argument_loc,
+                                     argument.symbol);
+        ast[type_node] =
+            ASTNode(ASTNodeClass::Type, types.kind(type), ast.store(type_name), argument_loc);
+        ast[argument_node].type = type;
+        ast[type_node].type     = type;
     }
 
     // Get the return type and add it to the graph
-    size_t location_return_rightArrow = location_parenR - lexemes.begin() + 1;
-    Lexeme expecting_right_arrow      = std::get<0>(lexemes[location_return_rightArrow]);
-    if(expecting_right_arrow.lexeme_type == LexemeClass::RightArrow) {
-        size_t location_return_parenL = location_parenR - lexemes.begin() + 2;
-        Lexeme expecting_return_type  = std::get<0>(lexemes[location_return_parenL]);
+    TypeId      return_type               = types.tuple({}); // void
+    Location    expecting_right_arrow_loc = lexemes.location();
+    LexemeClass expecting_right_arrow     = lexemes.peek_kind();
+    Location    body_loc                  = expecting_right_arrow_loc;
+    if(expecting_right_arrow == LexemeClass::RightArrow) {
         // TODO:: should validate that we have a return statement
-        if(expecting_return_type.lexeme_type == LexemeClass::ParenL) {
-            // TODO:: Parse return value types, arbitrary number
-            LOG_WARNING("NOT IMPLEMENTED: Parse arbitrary number return value types")
-            throw std::runtime_error("Unable to parse arbitrary number return value types");
-        }
-        else if(expecting_return_type.lexeme_type == LexemeClass::FloatType ||
-                expecting_return_type.lexeme_type == LexemeClass::IntegerType ||
-                expecting_return_type.lexeme_type == LexemeClass::UIntegerType) {
-            // Single return type
-            Location                loc_return_type = std::get<1>(lexemes[location_return_parenL]);
-            Tree::vertex_descriptor return_type     = boost::add_vertex(ast);
-            boost::add_edge(function_node, return_type, ast);
-            ast[return_type] = ASTNode(ASTNodeClass::Return,
-                                       ASTNodeSubType::none,
-                                       expecting_return_type.tokens,
-                                       loc_return_type);
-            LOG_DEBUG("Adding single return type in " << ast[function_node].name)
+        // Several return values are a tuple type, e.g. -> (i32, f32)
+        lexemes.next();
+        Location loc_return_type = lexemes.location();
+        return_type              = parse_type(lexemes);
+        if(return_type == no_type) {
+            return no_vertex;
         }
-        else {
-            LOG_ERROR("Expected type or ParenL after arguments, received "
-                      << expecting_identifier.tokens << " of type "
-                      << ename(expecting_identifier.lexeme_type) << " at "
-                      << std::get<1>(lexemes[location_return_parenL]))
-            throw std::runtime_error("Received unexpected lexeme");
+        vertex_t return_node = ast.add_vertex();
+        ast.add_edge(function_node, return_node);
+        ast[return_node] = ASTNode(ASTNodeClass::Return,
+                                   ASTNodeSubType::none,
+                                   ast.store(types.to_string(return_type)),
+                                   loc_return_type);
+        ast[return_node].type = return_type;
+        LOG_DEBUG("Adding return type " << ast[return_node].name << " in "
+                                        << ast[function_node].name)
+        // The body follows the return type
+        body_loc = lexemes.location();
+        if(!expect(lexemes, LexemeClass::CurlL, "after return type")) {
+            return no_vertex;
         }
     }
-    else if(expecting_right_arrow.lexeme_type == LexemeClass::CurlL) {
+    else if(expecting_right_arrow == LexemeClass::CurlL) {
         // Implies that the return type is void
-        Tree::vertex_descriptor return_type = boost::add_vertex(ast);
-        boost::add_edge(function_node, return_type, ast);
+        lexemes.next();
+        vertex_t return_node = ast.add_vertex();
+        ast.add_edge(function_node, return_node);
         // void return type put location of curlL
-        ast[return_type] = ASTNode(ASTNodeClass::Return,
-                                   ASTNodeSubType::none,
-                                   "void",
-                                   std::get<1>(lexemes[location_return_rightArrow]));
+        ast[return_node] =
+            ASTNode(ASTNodeClass::Return, ASTNodeSubType::none, "void", expecting_right_arrow_loc);
+        ast[return_node].type = return_type;
     }
     else {
-        LOG_ERROR("Expected RightArrow '->' after arguments, received "
-                  << expecting_right_arrow.tokens << " of type "
-                  << ename(expecting_right_arrow.lexeme_type) << " at "
-                  << std::get<1>(lexemes[location_return_rightArrow]))
-        throw std::runtime_error("Received unexpected lexeme");
-    }
-
-    auto location_curlL = std::find_if(lexemes.begin() + location_return_rightArrow,
-                                       lexemes.end(),
-                                       [](const std::tuple<Lexeme, Location>& x) {
-                                           return std::get<0>(x).lexeme_type == LexemeClass::CurlL;
-                                       });
-    x                   = location_curlL - lexemes.begin();
-    scope_stack.push(function_node);
-    return x;
-}
-
-void draw_graph(Tree ast) {
-    // Print the AST
-    LOG_INFO("AST Generated")
-    std::ofstream             outFile("tree_visualization.dot");
-    boost::dynamic_properties dp;
-
-    dp.property("label", boost::get(&ASTNode::name, ast));
-    dp.property("node_id", boost::get(boost::vertex_index, ast));
-    dp.property("label", boost::get(&ASTEdge::name, ast));
-    dp.property("fillcolor", boost::get(&ASTNode::_color, ast));
-    dp.property("style", boost::get(&ASTNode::_style, ast));
-    dp.property("shape", boost::get(&ASTNode::_shape, ast));
-    write_graphviz_dp(outFile, ast, dp);
-    outFile.close();
-    LOG_INFO("AST Graph in tree_visualization.dot")
-}
-
-[[nodiscard]] Tree generate_ast(std::vector<std::tuple<Lexeme, Location>> lexemes) {
-    LOG_INFO("Generating AST")
+        report_unexpected(lexemes, "RightArrow '->' after arguments");
+        return no_vertex;
+    }
+
+    std::vector<TypeId> parameters;
+    for(const auto& argument : arguments) {
+        parameters.push_back(std::get<1>(argument));
+    }
+    ast[function_node].type = types.func(parameters, return_type);
 
-    Tree                    ast;
-    Tree::vertex_descriptor root = boost::add_vertex(ast);
-    ast[root].name               = "root";
+    if(lazy_body) {
+        // Only the signature is built, parse_body finds the body again from its CurlL
+        std::optional<uint32_t> body_end = skip_braces(lexemes.source(), body_loc);
+        if(!body_end) {
+            lexemes.skip_to(static_cast<uint32_t>(lexemes.source().length()));
+            return no_vertex;
+        }
+        ast.unparsed_bodies.emplace(function_node, body_loc);
+        lexemes.skip_to(*body_end);
+        return function_node;
+    }
+    ast_gen_block(ast, function_node, lexemes);
+    return function_node;
+}
 
-    std::stack<Tree::vertex_descriptor> scope_stack;
-    scope_stack.push(root);
+[[nodiscard]] Tree generate_ast(TokenStream& lexemes, const ParseOptions& options) {
+    LOG_INFO("Generating AST")
 
-    // Insert the root node
-    for(int x = 0; x < lexemes.size(); x++) {
-        Lexeme   lexeme = std::get<0>(lexemes[x]);
-        Location loc    = std::get<1>(lexemes[x]);
+    Tree     ast;
+    vertex_t root  = ast.add_vertex();
+    ast[root].name = "root";
+    ast.source     = lexemes.source();
 
-        LOG_DEBUG("Lexeme: " << lexeme.tokens)
-        if(lexeme.lexeme_type == LexemeClass::Function) {
-            try {
-                x = ast_gen_function(ast, scope_stack, lexemes, x);
-            }
-            catch(std::exception& e) {
-                LOG_ERROR(e.what())
-                throw;
-            }
-        }
-        else if(lexeme.lexeme_type == LexemeClass::CurlR) {
-            scope_stack.pop();
+    // The file is the body of the root scope, only it may end at the end of the input
+    while(!lexemes.at_end() && !error_limit_reached()) {
+        if(lexemes.peek_kind() == LexemeClass::CurlR) {
+            report_error(lexemes.location(), "Unmatched CurlR '}'");
+            lexemes.next();
+            continue;
         }
-        else if(lexeme.lexeme_type == LexemeClass::Identifier) {
+        size_t statement_start = ast.size();
+        if(options.lazy_bodies && lexemes.peek_kind() == LexemeClass::Function &&
+           lexemes.peek_kind(1) == LexemeClass::Identifier) {
+            vertex_t function = ast_gen_function(ast, lexemes, true);
+            if(function == no_vertex) {
+                ast.truncate(statement_start);
+                synchronise(lexemes);
+                continue;
+            }
+            ast.add_edge(root, function);
+            continue;
         }
-        else if(lexeme.lexeme_type == LexemeClass::CurlL) {
-            vertex_t anonymous_scope = boost::add_vertex(ast);
-            boost::add_edge(scope_stack.top(), anonymous_scope, ast);
-            std::string scope_name = loc.file.filename().string() + "_" + std::to_string(loc.line) +
-                                     std::to_string(loc.column);
-            ast[anonymous_scope] =
-                ASTNode(ASTNodeClass::Function, ASTNodeSubType::func, scope_name, loc);
-            scope_stack.push(anonymous_scope);
+        if(!ast_gen_statement(ast, root, lexemes)) {
+            ast.truncate(statement_start);
+            synchronise(lexemes);
         }
     }
-    draw_graph(ast);
+    resolve_names(ast);
+    return ast;
+}
+
+[[nodiscard]] Tree generate_ast(const TokenBuffer& lexemes, const ParseOptions& options) {
+    PROFILE_SCOPE(probe, "generate_ast");
+    TokenStream stream(lexemes, false);
+    Tree        ast = generate_ast(stream, options);
+    PROFILE_COUNT(probe, bytes, ast.source.length());
+    PROFILE_COUNT(probe, tokens, lexemes.size());
+    PROFILE_COUNT(probe, nodes, ast.size());
+    return ast;
+}
+
+[[nodiscard]] Tree generate_ast(const SourceCode& source, const ParseOptions& options) {
+    // Lexing and parsing are interleaved, only the lookahead window of tokens exists at a time.
+    // The phase includes the lexing.
+    PROFILE_SCOPE(probe, "generate_ast");
+    Lexer       lexer(source);
+    TokenStream stream(lexer, false);
+    Tree        ast = generate_ast(stream, options);
+    PROFILE_COUNT(probe, bytes, ast.source.length());
+    PROFILE_COUNT(probe, tokens, stream.pulled());
+    PROFILE_COUNT(probe, nodes, ast.size());
     return ast;
 }
+
+void parse_body(Tree& ast, vertex_t function) {
+    auto unparsed = ast.unparsed_bodies.find(function);
+    if(unparsed == ast.unparsed_bodies.end()) {
+        return;
+    }
+    Location open = unparsed->second;
+    ast.unparsed_bodies.erase(unparsed);
+    // The body is lexed again from its CurlL, the block ends at the matching CurlR
+    Lexer lexer(ast.source, open.file_id);
+    lexer.seek(open.offset);
+    TokenStream stream(lexer, false);
+    if(!expect(stream, LexemeClass::CurlL, "to open the function body")) {
+        return;
+    }
+    ast_gen_block(ast, function, stream);
+    resolve_names(ast, function);
+}
+
+void parse_reachable(Tree& ast, vertex_t function) {
+    PROFILE_SCOPE(probe, "parse_reachable");
+    PROFILE_COUNT(probe, nodes, ast.size()); // Until the end, then the nodes it added
+    // Every function is visited once, its body is parsed and walked for the functions it uses
+    std::vector<vertex_t>        needed{function};
+    std::unordered_set<vertex_t> visited{function};
+    std::vector<vertex_t>        walk;
+    while(!needed.empty()) {
+        vertex_t current = needed.back();
+        needed.pop_back();
+        parse_body(ast, current);
+        walk.push_back(current);
+        while(!walk.empty()) {
+            vertex_t node = walk.back();
+            walk.pop_back();
+            vertex_t declaration = ast.declaration(node);
+            if(declaration != no_vertex &&
+               ast[declaration].node_class == ASTNodeClass::Function &&
+               visited.insert(declaration).second) {
+                needed.push_back(declaration);
+            }
+            for(vertex_t child = ast.first_child(node); child != no_vertex;
+                child          = ast.next_sibling(child)) {
+                walk.push_back(child);
+            }
+        }
+    }
+    PROFILE_COUNT(probe, nodes, ast.size() - probe.counts.nodes);
+}
@@ -1,24 +1,25 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <stdexcept>
 #include <utility>
 
 #include <stack>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/detail/adjacency_list.hpp>
-#include <boost/graph/graph_selectors.hpp>
-#include <boost/graph/graphviz.hpp>
-#include <boost/graph/subgraph.hpp>
-#include <boost/property_map/property_map.hpp>
+#include <boost/range/irange.hpp>
 #include <magic_enum_all.hpp>
 
+#include "Arena.hpp"
+#include "Keywords.hpp"
 #include "Lexer.hpp"
+#include "Types.hpp"
 
-enum ASTNodeClass {
+enum ASTNodeClass : uint8_t {
     Root,
 
     Function,
@@ -26,67 +27,119 @@ enum ASTNodeClass {
     Argument,
     Return,
 
-    Expression, // e.g x = 1 + 2
+    Expression, // e.g x = 1 + 2, named by the operator with the operands as children
     Declaration, // e.g x : i32
-};
-
-enum ASTNodeSubType {
-    boolean,
-
-    i8,
-    i16,
-    i32,
-    i64,
-    i128,
-
-    u8,
-    u16,
-    u32,
-    u64,
-    u128,
-
-    f32,
-    f64,
+    ReturnStatement, // e.g return x, the returned expression is the child
 
-    array,
-    tuple,
-    map,
-
-    func,
-    none,
+    Identifier, // e.g x
+    Literal, // e.g 4.2, sub type i64 for integers and f64 for floats
+    Call, // e.g add(1, 2), the callee then the arguments are the children
+    Cast, // e.g x as f32, the target type is the node's type
+    List, // e.g [1, 4], [1 : 1] or (x, y), sub type array, map or tuple
 };
 
 class ASTNode {
 public:
-    ASTNodeClass   node_class;
-    ASTNodeSubType sub_type;
-    std::string    name;
-    Location       location;
-    std::string    _color;
-    std::string    _style = "filled";
-    std::string    _shape;
+    // Kept small, the presentation of a node for graphviz is derived from its class when drawn
+    ASTNodeClass     node_class;
+    ASTNodeSubType   sub_type;
+    std::string_view name; // Span of the source, or of the tree's arena for generated names
+    TypeId           type; // Interned type of Type, Argument and Return nodes, no_type otherwise
+    Symbol           symbol; // Interned name of the identifier the node declares or uses
+    Location         location;
 
     ASTNode();
-    ASTNode(ASTNodeClass type, ASTNodeSubType subtype, std::string name, const Location& location);
-    [[nodiscard]] std::string _get_graph_color() const;
-    [[nodiscard]] std::string _get_graph_shape() const;
+    ASTNode(ASTNodeClass     type,
+            ASTNodeSubType   subtype,
+            std::string_view name,
+            const Location&  location,
+            Symbol           symbol = no_symbol);
+    [[nodiscard]] const char* _get_graph_color() const;
+    [[nodiscard]] const char* _get_graph_shape() const;
     ~ASTNode();
 };
 
-class ASTEdge {
+typedef uint32_t vertex_t;
+constexpr vertex_t no_vertex = UINT32_MAX;
+
+class Tree {
 public:
-    std::string name;
+    // Flat AST. Nodes and their links are parallel arrays indexed by a 32 bit vertex_t, children
+    // are threaded through first_children/next_siblings so a node can gain children at any time
+    // while keeping one array walk per traversal. Names that are not a span of the source are
+    // copied into an arena shared by copies of the tree.
+    //
+    // Lifetime: every other name, and source itself, is a view into the SourceCode the tree was
+    // parsed from, nothing is copied. That SourceCode (its string or its mapping) has to outlive
+    // the tree and every copy of it, CompileResult keeps the two together for this reason.
+    std::vector<ASTNode>  nodes;
+    std::vector<vertex_t> parents;
+    std::vector<vertex_t> first_children;
+    std::vector<vertex_t> last_children;
+    std::vector<vertex_t> next_siblings;
+    // Declaration each name use resolves to, filled in by resolve_names
+    std::vector<vertex_t> declarations;
+    // Functions whose body a lazy parse skipped, with the location of the body's CurlL, and the
+    // source the bodies are parsed from once needed
+    std::unordered_map<vertex_t, Location> unparsed_bodies;
+    std::string_view                       source;
+
+    Tree();
+    ~Tree();
+
+    vertex_t add_vertex(const ASTNode& node = ASTNode());
+    // Attach child as the last child of parent, a node has at most one parent
+    void     add_edge(vertex_t parent, vertex_t child);
+    // Record that the name used by use is declared by declaration
+    void     bind(vertex_t use, vertex_t declaration);
+    // Remove the vertices from size on and every link to them, undoes a statement that failed
+    void     truncate(size_t size);
+
+    [[nodiscard]] size_t         size() const;
+    [[nodiscard]] ASTNode&       operator[](vertex_t vertex);
+    [[nodiscard]] const ASTNode& operator[](vertex_t vertex) const;
+    [[nodiscard]] vertex_t       parent(vertex_t vertex) const;
+    [[nodiscard]] vertex_t       first_child(vertex_t vertex) const;
+    [[nodiscard]] vertex_t       next_sibling(vertex_t vertex) const;
+    [[nodiscard]] vertex_t       declaration(vertex_t vertex) const;
+    [[nodiscard]] bool           body_parsed(vertex_t function) const;
+    [[nodiscard]] boost::integer_range<vertex_t> vertex_set() const;
+
+    // Copy text that does not live in the source into the tree's arena
+    std::string_view store(std::string_view text);
+
+private:
+    std::shared_ptr<Arena> arena;
 };
 
-typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::bidirectionalS, ASTNode, ASTEdge>
-                                                     Tree;
-typedef boost::graph_traits<Tree>::vertex_descriptor vertex_t;
-typedef boost::graph_traits<Tree>::edge_descriptor   edge_t;
+// Deepest nesting of statements, expressions and types the parser descends into. Anything deeper
+// is reported as an error and skipped, it never overflows the stack.
+constexpr size_t max_nesting = 256;
 
-void draw_graph(Tree ast);
+class ParseOptions {
+public:
+    // Top level functions keep only their signature, the body is skipped by balancing braces and
+    // parsed by parse_body the first time it is needed
+    bool lazy_bodies = false;
+};
 
-std::tuple<Tree, vertex_t> parse_type(std::vector<std::tuple<Lexeme, Location>>& type_lexemes,
-                                      std::stack<vertex_t>&                      type_stack,
-                                      Tree&                                      type_tree,
-                                      Location                                   root_location);
-Tree                       generate_ast(std::vector<std::tuple<Lexeme, Location>> lexemes);
\ No newline at end of file
+// Consume one type from the stream and intern it, the tokens are never copied. Errors are reported
+// to currentDiagnostics and give no_type.
+TypeId                     parse_type(TokenStream& lexemes);
+// Parse a whole buffer as one type and spell it out as a tree of Type nodes, no_vertex if it is not
+// exactly one type
+std::tuple<Tree, vertex_t> parse_type(const TokenBuffer& type_lexemes, Location root_location);
+// Type nodes of an interned type below a new node, which is returned
+vertex_t                   add_type_nodes(Tree& tree, TypeId type, const Location& location);
+// Single pass parser, linear in the number of tokens. The stream has to be built without comments.
+// Nothing is thrown for malformed input: every error is reported to currentDiagnostics, the
+// statement it is in is skipped and the tree holds the rest of the file.
+Tree generate_ast(TokenStream& lexemes, const ParseOptions& options = ParseOptions());
+Tree generate_ast(const TokenBuffer& lexemes, const ParseOptions& options = ParseOptions());
+// Parse straight from the source, tokens are pulled from the lexer as the parser needs them
+Tree generate_ast(const SourceCode& source, const ParseOptions& options = ParseOptions());
+// Parse and resolve the body a lazy parse skipped, nothing happens if it is already parsed. The
+// source the tree was parsed from has to be alive.
+void parse_body(Tree& ast, vertex_t function);
+// Parse the body of function and of every function it refers to, transitively
+void parse_reachable(Tree& ast, vertex_t function);
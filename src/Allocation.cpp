@@ -0,0 +1,298 @@
+#include "Allocation.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace {
+
+class PhaseCounters {
+public:
+    std::atomic<const char*> phase;
+    std::atomic<uint64_t>    count;
+    std::atomic<uint64_t>    bytes;
+    std::atomic<uint64_t>    live;
+    std::atomic<uint64_t>    peak;
+};
+
+// Zero initialised before any constructor runs, operator new may be called before main. The last
+// slot holds the process totals.
+PhaseCounters         counters[AllocationTracker::max_phases + 1];
+std::atomic<uint32_t> phase_count{1};
+std::mutex            registration;
+constexpr uint32_t    total_slot = AllocationTracker::max_phases;
+
+class AllocationHeader {
+public:
+    // Just before the memory handed out, 16 bytes so default alignment is kept
+    uint64_t size;
+    uint32_t slot;
+    uint32_t reserved;
+};
+static_assert(sizeof(AllocationHeader) == 16);
+
+void raise_peak(std::atomic<uint64_t>& peak, uint64_t live) {
+    uint64_t seen = peak.load(std::memory_order_relaxed);
+    while(live > seen && !peak.compare_exchange_weak(seen, live, std::memory_order_relaxed)) {
+    }
+}
+
+void add(uint32_t slot, size_t size) {
+    PhaseCounters& phase = counters[slot];
+    phase.count.fetch_add(1, std::memory_order_relaxed);
+    phase.bytes.fetch_add(size, std::memory_order_relaxed);
+    raise_peak(phase.peak, phase.live.fetch_add(size, std::memory_order_relaxed) + size);
+}
+
+AllocationStats stats_of(uint32_t slot) {
+    AllocationStats stats;
+    stats.phase = counters[slot].phase.load(std::memory_order_acquire);
+    stats.count = counters[slot].count.load(std::memory_order_relaxed);
+    stats.bytes = counters[slot].bytes.load(std::memory_order_relaxed);
+    stats.live  = counters[slot].live.load(std::memory_order_relaxed);
+    stats.peak  = counters[slot].peak.load(std::memory_order_relaxed);
+    if(stats.phase == nullptr) {
+        stats.phase = slot == total_slot ? "total" : "other";
+    }
+    return stats;
+}
+
+size_t header_size(size_t alignment) {
+    return std::max(alignment, sizeof(AllocationHeader));
+}
+
+AllocationHeader* header_of(void* memory) {
+    return static_cast<AllocationHeader*>(memory) - 1;
+}
+
+void* allocate_with_header(void* raw, size_t size, size_t alignment, uint32_t slot) {
+    // The header sits at the end of an alignment sized prefix, so the memory stays aligned
+    if(raw == nullptr) {
+        return nullptr;
+    }
+    void*             memory = static_cast<char*>(raw) + header_size(alignment);
+    AllocationHeader* header = header_of(memory);
+    header->size             = size;
+    header->slot             = slot;
+    if(slot != AllocationTracker::untracked) {
+        AllocationTracker::record_allocation(slot, size);
+    }
+    return memory;
+}
+
+void* release_header(void* memory, size_t alignment) {
+    AllocationHeader* header = header_of(memory);
+    if(header->slot != AllocationTracker::untracked) {
+        AllocationTracker::record_deallocation(header->slot, header->size);
+    }
+    return static_cast<char*>(memory) - header_size(alignment);
+}
+
+uint32_t allocating_slot() {
+    return AllocationTracker::enabled() ? currentAllocationPhase : AllocationTracker::untracked;
+}
+
+class TrackingResource : public std::pmr::memory_resource {
+public:
+    explicit TrackingResource(std::pmr::memory_resource* upstream) {
+        this->upstream = upstream;
+    }
+
+private:
+    std::pmr::memory_resource* upstream;
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        // Upstream operator new must not count the same bytes again
+        uint32_t phase         = currentAllocationPhase;
+        uint32_t slot          = allocating_slot();
+        currentAllocationPhase = AllocationTracker::untracked;
+        void* raw              = nullptr;
+        try {
+            raw = this->upstream->allocate(bytes + header_size(alignment),
+                                           std::max(alignment, alignof(AllocationHeader)));
+        }
+        catch(...) {
+            currentAllocationPhase = phase;
+            throw;
+        }
+        currentAllocationPhase = phase;
+        return allocate_with_header(raw, bytes, alignment, slot);
+    }
+
+    void do_deallocate(void* memory, size_t bytes, size_t alignment) override {
+        uint32_t phase         = currentAllocationPhase;
+        currentAllocationPhase = AllocationTracker::untracked;
+        this->upstream->deallocate(release_header(memory, alignment),
+                                   bytes + header_size(alignment),
+                                   std::max(alignment, alignof(AllocationHeader)));
+        currentAllocationPhase = phase;
+    }
+
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+} // namespace
+
+void AllocationTracker::enable() {
+    active.store(true, std::memory_order_relaxed);
+}
+
+uint32_t AllocationTracker::phase_slot(const char* phase) {
+    // Phases are few and looked up once per probe, a scan is enough. Names are compared by
+    // content, the same literal may have another address in another translation unit.
+    uint32_t known = phase_count.load(std::memory_order_acquire);
+    for(uint32_t slot = 1; slot < known; slot++) {
+        if(std::strcmp(counters[slot].phase.load(std::memory_order_relaxed), phase) == 0) {
+            return slot;
+        }
+    }
+    std::lock_guard<std::mutex> lock(registration);
+    known = phase_count.load(std::memory_order_relaxed);
+    for(uint32_t slot = 1; slot < known; slot++) {
+        if(std::strcmp(counters[slot].phase.load(std::memory_order_relaxed), phase) == 0) {
+            return slot;
+        }
+    }
+    if(known == max_phases) {
+        return 0;
+    }
+    counters[known].phase.store(phase, std::memory_order_relaxed);
+    phase_count.store(known + 1, std::memory_order_release);
+    return known;
+}
+
+uint32_t AllocationTracker::enter(uint32_t slot) {
+    uint32_t previous      = currentAllocationPhase;
+    currentAllocationPhase = slot;
+    return previous;
+}
+
+void AllocationTracker::leave(uint32_t previous) {
+    currentAllocationPhase = previous;
+}
+
+void AllocationTracker::record_allocation(uint32_t slot, size_t size) {
+    add(slot, size);
+    add(total_slot, size);
+}
+
+void AllocationTracker::record_deallocation(uint32_t slot, size_t size) {
+    counters[slot].live.fetch_sub(size, std::memory_order_relaxed);
+    counters[total_slot].live.fetch_sub(size, std::memory_order_relaxed);
+}
+
+std::vector<AllocationStats> AllocationTracker::phases() {
+    std::vector<AllocationStats> phases;
+    uint32_t                     known = phase_count.load(std::memory_order_acquire);
+    for(uint32_t slot = 0; slot < known; slot++) {
+        phases.push_back(stats_of(slot));
+    }
+    return phases;
+}
+
+AllocationStats AllocationTracker::total() {
+    return stats_of(total_slot);
+}
+
+void AllocationTracker::reset_peaks() {
+    for(PhaseCounters& phase : counters) {
+        phase.peak.store(phase.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+void AllocationTracker::write_report(std::ostream& out) {
+    // Built before printing, so the report's own allocations are not in it
+    std::vector<AllocationStats> rows = phases();
+    rows.push_back(total());
+    out << "Allocation report, bytes asked for by each phase\n";
+    char line[256];
+    std::snprintf(line,
+                  sizeof(line),
+                  "%-14s %12s %14s %14s %14s\n",
+                  "phase",
+                  "allocations",
+                  "bytes",
+                  "peak live",
+                  "live");
+    out << line;
+    for(const AllocationStats& row : rows) {
+        std::snprintf(line,
+                      sizeof(line),
+                      "%-14s %12llu %14llu %14llu %14llu\n",
+                      row.phase,
+                      static_cast<unsigned long long>(row.count),
+                      static_cast<unsigned long long>(row.bytes),
+                      static_cast<unsigned long long>(row.peak),
+                      static_cast<unsigned long long>(row.live));
+        out << line;
+    }
+    if(!hooks_operator_new) {
+        out << "Only memory resource allocations are counted, operator new is not tracked in "
+               "this build\n";
+    }
+}
+
+std::pmr::memory_resource* AllocationTracker::resource() {
+    static TrackingResource resource(std::pmr::new_delete_resource());
+    return &resource;
+}
+
+#if RAJ_ALLOCATION_TRACKING
+
+// Every allocation of the process gets a header, counted or not, so any pointer can be freed
+void* operator new(size_t size) {
+    void* memory = allocate_with_header(
+        std::malloc(size + header_size(1)), size, 1, allocating_slot());
+    if(memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate_with_header(std::malloc(size + header_size(1)), size, 1, allocating_slot());
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    auto   align  = static_cast<size_t>(alignment);
+    size_t length = (size + header_size(align) + align - 1) / align * align;
+    void*  memory = allocate_with_header(
+        std::aligned_alloc(align, length), size, align, allocating_slot());
+    if(memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    auto   align  = static_cast<size_t>(alignment);
+    size_t length = (size + header_size(align) + align - 1) / align * align;
+    return allocate_with_header(std::aligned_alloc(align, length), size, align, allocating_slot());
+}
+
+void operator delete(void* memory) noexcept {
+    if(memory != nullptr) {
+        std::free(release_header(memory, 1));
+    }
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+void operator delete(void* memory, std::align_val_t alignment) noexcept {
+    if(memory != nullptr) {
+        std::free(release_header(memory, static_cast<size_t>(alignment)));
+    }
+}
+
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <ostream>
+#include <vector>
+
+// Global operator new and delete are only replaced in builds that ask for it, every allocation
+// then carries a small header saying what to count when it is freed
+#ifndef RAJ_ALLOCATION_TRACKING
+#define RAJ_ALLOCATION_TRACKING 0
+#endif
+
+class AllocationStats {
+public:
+    const char* phase = nullptr;
+    uint64_t    count = 0; // Allocations made
+    uint64_t    bytes = 0; // Bytes asked for
+    uint64_t    live  = 0; // Bytes not freed yet
+    uint64_t    peak  = 0; // Most bytes live at once
+};
+
+class AllocationTracker {
+public:
+    // Allocations are attributed to the phase probe innermost on the allocating thread, or to
+    // "other" outside of every phase. Memory freed in a later phase still counts against the
+    // phase that allocated it. Nothing is counted until the tracker is enabled.
+    static constexpr uint32_t max_phases = 32;
+    static constexpr uint32_t untracked  = UINT32_MAX;
+    // Whether global operator new and delete are counted, allocations from resource() always are
+    static constexpr bool     hooks_operator_new = RAJ_ALLOCATION_TRACKING;
+
+    static void enable();
+    static bool enabled() {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    // Slot counting the allocations of a phase, made on first use. Phases past max_phases share
+    // the slot of "other".
+    static uint32_t phase_slot(const char* phase);
+    // Count this thread's allocations towards slot, returns the slot to go back to
+    static uint32_t enter(uint32_t slot);
+    static void     leave(uint32_t previous);
+
+    static void record_allocation(uint32_t slot, size_t size);
+    static void record_deallocation(uint32_t slot, size_t size);
+
+    [[nodiscard]] static std::vector<AllocationStats> phases();
+    [[nodiscard]] static AllocationStats              total();
+    // Peaks start again from what is live now, to measure the peak of one piece of work
+    static void                                       reset_peaks();
+    // Count, bytes, peak and live bytes of every phase, then of the process
+    static void                                       write_report(std::ostream& out);
+
+    // Counts what is allocated through it. The allocations it makes upstream are not counted a
+    // second time by operator new.
+    static std::pmr::memory_resource* resource();
+
+private:
+    static inline std::atomic<bool> active{false};
+};
+
+// Slot the allocations of this thread count towards
+inline thread_local uint32_t currentAllocationPhase = 0;
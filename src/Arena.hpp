@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+// Resource arenas take their blocks from when they are not given one, set by the compilation
+// running on this thread. The default memory resource is used outside of any.
+inline thread_local std::pmr::memory_resource* currentArenaResource = nullptr;
+
+class Arena {
+public:
+    // Bump allocator, memory is handed out from large blocks and only released with the arena.
+    // Nothing is destroyed, so it only holds trivially destructible data such as node names.
+    // Blocks come from upstream, or the current arena resource at the time the arena is made.
+    explicit Arena(size_t block_size = 1 << 16, std::pmr::memory_resource* upstream = nullptr) {
+        if(upstream == nullptr) {
+            upstream = currentArenaResource != nullptr ? currentArenaResource
+                                                       : std::pmr::get_default_resource();
+        }
+        this->block_size = block_size;
+        this->upstream   = upstream;
+        this->cursor     = nullptr;
+        this->limit      = nullptr;
+        this->used       = 0;
+    }
+    Arena(const Arena&)            = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() {
+        for(const Block& block : this->blocks) {
+            this->upstream->deallocate(block.memory, block.size, alignof(std::max_align_t));
+        }
+    }
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        auto address = reinterpret_cast<uintptr_t>(this->cursor);
+        auto aligned = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+        if(this->cursor == nullptr || aligned + size > reinterpret_cast<uintptr_t>(this->limit)) {
+            // Oversized requests get a block of their own
+            size_t capacity = std::max(this->block_size, size + alignment);
+            auto   block    = static_cast<char*>(
+                this->upstream->allocate(capacity, alignof(std::max_align_t)));
+            this->blocks.push_back(Block{block, capacity});
+            this->cursor = block;
+            this->limit  = this->cursor + capacity;
+            address      = reinterpret_cast<uintptr_t>(this->cursor);
+            aligned      = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+        }
+        this->cursor = reinterpret_cast<char*>(aligned + size);
+        this->used += size;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    // Copy of the text that lives as long as the arena
+    std::string_view store(std::string_view text) {
+        if(text.empty()) {
+            return {};
+        }
+        auto copy = static_cast<char*>(this->allocate(text.length(), 1));
+        std::memcpy(copy, text.data(), text.length());
+        return {copy, text.length()};
+    }
+
+    [[nodiscard]] size_t bytes_used() const {
+        return this->used;
+    }
+
+private:
+    class Block {
+    public:
+        char*  memory;
+        size_t size;
+    };
+
+    std::vector<Block>         blocks;
+    size_t                     block_size;
+    std::pmr::memory_resource* upstream;
+    char*                      cursor;
+    char*                      limit;
+    size_t                     used;
+};
@@ -0,0 +1,609 @@
+#include "BinaryAST.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RAJ_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+class SectionWriter {
+public:
+    // Sections are appended at 8 byte aligned offsets, the header is written over the start last
+    std::string out = std::string(sizeof(AstFileHeader), '\0');
+
+    template <typename T> AstFileSection append(const T* values, size_t count) {
+        this->out.append((8 - this->out.size() % 8) % 8, '\0');
+        AstFileSection section{this->out.size(), count};
+        this->out.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+        return section;
+    }
+    template <typename T> AstFileSection append(const std::vector<T>& values) {
+        return this->append(values.data(), values.size());
+    }
+};
+
+class StringTable {
+public:
+    // Every distinct text is stored once, symbols are looked up once per Symbol
+    std::vector<AstFileString>                     strings;
+    std::string                                    data;
+    std::unordered_map<std::string_view, uint32_t> indices;
+    std::unordered_map<Symbol, uint32_t>           symbols;
+
+    uint32_t add(std::string_view text) {
+        auto index          = static_cast<uint32_t>(this->strings.size());
+        auto [found, added] = this->indices.emplace(text, index);
+        if(added) {
+            this->strings.push_back(AstFileString{static_cast<uint32_t>(this->data.size()),
+                                                  static_cast<uint32_t>(text.length())});
+            this->data.append(text);
+        }
+        return found->second;
+    }
+    uint32_t add_symbol(Symbol symbol) {
+        if(symbol == no_symbol) {
+            return ast_file_none;
+        }
+        auto found = this->symbols.find(symbol);
+        if(found != this->symbols.end()) {
+            return found->second;
+        }
+        uint32_t index = this->add(SymbolTable::current().name(symbol));
+        this->symbols.emplace(symbol, index);
+        return index;
+    }
+};
+
+class TypeList {
+public:
+    // Types of the tree in an order where operands come before the types made of them
+    std::vector<AstFileType>             types;
+    std::vector<uint32_t>                operands;
+    std::unordered_map<TypeId, uint32_t> indices;
+
+    uint32_t add(TypeId type) {
+        if(type == no_type) {
+            return ast_file_none;
+        }
+        auto found = this->indices.find(type);
+        if(found != this->indices.end()) {
+            return found->second;
+        }
+        TypeTable&            table = TypeTable::current();
+        std::vector<uint32_t> local;
+        for(TypeId operand : table.operands(type)) {
+            local.push_back(this->add(operand));
+        }
+        AstFileType entry{};
+        entry.kind          = table.kind(type);
+        entry.first_operand = static_cast<uint32_t>(this->operands.size());
+        entry.operand_count = static_cast<uint32_t>(local.size());
+        this->operands.insert(this->operands.end(), local.begin(), local.end());
+        auto index = static_cast<uint32_t>(this->types.size());
+        this->types.push_back(entry);
+        this->indices.emplace(type, index);
+        return index;
+    }
+};
+
+} // namespace
+
+AstView::AstView() {
+    this->head    = nullptr;
+    this->problem = "there is no data";
+}
+
+AstView::AstView(std::string_view data) {
+    this->data    = data;
+    this->head    = nullptr;
+    this->problem = nullptr;
+    if(data.length() < sizeof(AstFileHeader) ||
+       reinterpret_cast<uintptr_t>(data.data()) % alignof(uint64_t) != 0) {
+        this->damaged("the header is missing");
+        return;
+    }
+    const auto* header = reinterpret_cast<const AstFileHeader*>(data.data());
+    if(std::memcmp(header->magic, ast_file_magic, sizeof(ast_file_magic)) != 0) {
+        this->damaged("it is not a binary AST");
+        return;
+    }
+    if(header->version != ast_file_version || header->byte_order != ast_file_byte_order) {
+        this->damaged("it is of another version or byte order");
+        return;
+    }
+    size_t count = header->nodes.count;
+    this->nodes  = this->section<AstFileNode>(header->nodes);
+    const AstFileSection* link_sections[5] = {&header->parents,
+                                              &header->first_children,
+                                              &header->last_children,
+                                              &header->next_siblings,
+                                              &header->declarations};
+    for(size_t i = 0; i < 5; i++) {
+        if(link_sections[i]->count != count) {
+            this->damaged("links do not match the nodes");
+        }
+        this->links[i] = this->section<uint32_t>(*link_sections[i]);
+    }
+    this->strings     = this->section<AstFileString>(header->strings);
+    this->string_data = this->section<char>(header->string_data);
+    this->types       = this->section<AstFileType>(header->types);
+    this->operands    = this->section<uint32_t>(header->operands);
+    size_t tokens     = header->token_kinds.count;
+    if(header->token_offsets.count != tokens || header->token_lengths.count != tokens ||
+       header->token_symbols.count != tokens) {
+        this->damaged("token sections differ in length");
+    }
+    this->token_kinds   = this->section<uint8_t>(header->token_kinds);
+    this->token_offsets = this->section<uint32_t>(header->token_offsets);
+    this->token_lengths = this->section<uint32_t>(header->token_lengths);
+    this->token_symbols = this->section<uint32_t>(header->token_symbols);
+    this->bodies        = this->section<AstFileBody>(header->unparsed_bodies);
+    if(this->problem == nullptr) {
+        // Only a view whose every section checked out has a header, a damaged one is empty
+        this->head = header;
+    }
+}
+
+bool AstView::damaged(const char* what) const {
+    LOG_DEBUG("Binary AST check failed: " << what)
+    this->problem = what;
+    return false;
+}
+
+const char* AstView::damage() const {
+    return this->problem;
+}
+
+template <typename T> const T* AstView::section(const AstFileSection& section) const {
+    if(section.offset % alignof(T) != 0 || section.offset > this->data.length() ||
+       section.count > (this->data.length() - section.offset) / sizeof(T)) {
+        this->damaged("a section lies outside the file");
+        return nullptr;
+    }
+    return reinterpret_cast<const T*>(this->data.data() + section.offset);
+}
+
+bool AstView::validate() const {
+    if(this->head == nullptr) {
+        return false;
+    }
+    size_t count        = this->size();
+    size_t string_count = this->head->strings.count;
+    size_t type_count   = this->head->types.count;
+    auto   in_range     = [](uint32_t index, size_t limit) {
+        return index == ast_file_none || index < limit;
+    };
+    for(size_t i = 0; i < string_count; i++) {
+        if(this->strings[i].offset > this->head->string_data.count ||
+           this->strings[i].length > this->head->string_data.count - this->strings[i].offset) {
+            return this->damaged("a string lies outside the string data");
+        }
+    }
+    for(size_t i = 0; i < type_count; i++) {
+        const AstFileType& type = this->types[i];
+        if(!magic_enum::enum_contains<ASTNodeSubType>(type.kind) ||
+           type.first_operand > this->head->operands.count ||
+           type.operand_count > this->head->operands.count - type.first_operand) {
+            return this->damaged("a type is unknown");
+        }
+        for(uint32_t k = 0; k < type.operand_count; k++) {
+            if(this->operands[type.first_operand + k] >= i) {
+                return this->damaged("a type refers to a later type");
+            }
+        }
+    }
+    for(size_t v = 0; v < count; v++) {
+        const AstFileNode& node = this->nodes[v];
+        if(!magic_enum::enum_contains<ASTNodeClass>(node.node_class) ||
+           !magic_enum::enum_contains<ASTNodeSubType>(node.sub_type) ||
+           node.name >= string_count || !in_range(node.symbol, string_count) ||
+           !in_range(node.type, type_count) || node.offset > this->head->source_length) {
+            return this->damaged("a node is unknown");
+        }
+        for(const uint32_t* link : this->links) {
+            if(!in_range(link[v], count)) {
+                return this->damaged("a link points past the nodes");
+            }
+        }
+    }
+    // The links have to form a forest, or walking them could loop. Each chain of children holds
+    // the nodes naming that parent once each and ends at its last child, and every node is
+    // reached from a node without a parent.
+    const uint32_t*   parents        = this->links[0];
+    const uint32_t*   first_children = this->links[1];
+    const uint32_t*   last_children  = this->links[2];
+    const uint32_t*   next_siblings  = this->links[3];
+    std::vector<bool> in_chain(count, false);
+    for(size_t v = 0; v < count; v++) {
+        uint32_t last = ast_file_none;
+        // Every step marks a node not seen before, so this ends within count steps
+        for(uint32_t child = first_children[v]; child != ast_file_none;
+            child          = next_siblings[child]) {
+            if(in_chain[child] || parents[child] != v) {
+                return this->damaged("a child does not name its parent");
+            }
+            in_chain[child] = true;
+            last            = child;
+        }
+        if(last != last_children[v]) {
+            return this->damaged("a last child is not the end of its chain");
+        }
+    }
+    std::vector<uint32_t> pending;
+    for(size_t v = 0; v < count; v++) {
+        if((parents[v] != ast_file_none) != in_chain[v]) {
+            return this->damaged("a node is missing from the children of its parent");
+        }
+        if(parents[v] == ast_file_none) {
+            pending.push_back(static_cast<uint32_t>(v));
+        }
+    }
+    size_t reached = 0;
+    while(!pending.empty()) {
+        uint32_t v = pending.back();
+        pending.pop_back();
+        reached++;
+        for(uint32_t child = first_children[v]; child != ast_file_none;
+            child          = next_siblings[child]) {
+            pending.push_back(child);
+        }
+    }
+    if(reached != count) {
+        return this->damaged("the parents form a cycle");
+    }
+    for(size_t i = 0; i < this->token_count(); i++) {
+        if(!magic_enum::enum_contains<LexemeClass>(this->token_kinds[i]) ||
+           this->token_offsets[i] > this->head->source_length ||
+           this->token_lengths[i] > this->head->source_length - this->token_offsets[i] ||
+           !in_range(this->token_symbols[i], string_count)) {
+            return this->damaged("a token lies outside the source");
+        }
+    }
+    for(size_t i = 0; i < this->head->unparsed_bodies.count; i++) {
+        if(this->bodies[i].function >= count ||
+           this->bodies[i].offset >= this->head->source_length) {
+            return this->damaged("a skipped body lies outside the source");
+        }
+    }
+    return true;
+}
+
+const AstFileHeader& AstView::header() const {
+    return *this->head;
+}
+
+size_t AstView::size() const {
+    return this->head == nullptr ? 0 : this->head->nodes.count;
+}
+
+const AstFileNode& AstView::node(vertex_t vertex) const {
+    return this->nodes[vertex];
+}
+
+std::string_view AstView::name(vertex_t vertex) const {
+    return this->string(this->nodes[vertex].name);
+}
+
+vertex_t AstView::parent(vertex_t vertex) const {
+    return this->links[0][vertex];
+}
+
+vertex_t AstView::first_child(vertex_t vertex) const {
+    return this->links[1][vertex];
+}
+
+vertex_t AstView::last_child(vertex_t vertex) const {
+    return this->links[2][vertex];
+}
+
+vertex_t AstView::next_sibling(vertex_t vertex) const {
+    return this->links[3][vertex];
+}
+
+vertex_t AstView::declaration(vertex_t vertex) const {
+    return this->links[4][vertex];
+}
+
+std::string_view AstView::string(uint32_t index) const {
+    return std::string_view(this->string_data + this->strings[index].offset,
+                            this->strings[index].length);
+}
+
+const AstFileType& AstView::type(uint32_t index) const {
+    return this->types[index];
+}
+
+uint32_t AstView::operand(uint32_t type, uint32_t i) const {
+    return this->operands[this->types[type].first_operand + i];
+}
+
+void AstView::append_type_name(uint32_t index, std::string& out) const {
+    // Spelled the way TypeTable::to_string spells the interned type
+    const AstFileType& type = this->types[index];
+    auto               kind = static_cast<ASTNodeSubType>(type.kind);
+    auto               list = [&](uint32_t first, char open, char close) {
+        out += open;
+        for(uint32_t i = first; i < type.operand_count; i++) {
+            out += (i == first ? "" : ", ");
+            this->append_type_name(this->operand(index, i), out);
+        }
+        out += close;
+    };
+    switch(kind) {
+    case ASTNodeSubType::array:
+    case ASTNodeSubType::map:
+        out += TypeTable::kind_name(kind);
+        list(0, '<', '>');
+        break;
+    case ASTNodeSubType::tuple:
+        list(0, '(', ')');
+        break;
+    case ASTNodeSubType::func:
+        out += "func";
+        list(1, '<', '>');
+        out += " -> ";
+        this->append_type_name(this->operand(index, 0), out);
+        break;
+    default:
+        out += TypeTable::kind_name(kind);
+    }
+}
+
+std::string AstView::type_name(uint32_t index) const {
+    std::string out;
+    this->append_type_name(index, out);
+    return out;
+}
+
+size_t AstView::token_count() const {
+    return this->head == nullptr ? 0 : this->head->token_kinds.count;
+}
+
+LexemeClass AstView::token_kind(size_t i) const {
+    return static_cast<LexemeClass>(this->token_kinds[i]);
+}
+
+uint32_t AstView::token_offset(size_t i) const {
+    return this->token_offsets[i];
+}
+
+uint32_t AstView::token_length(size_t i) const {
+    return this->token_lengths[i];
+}
+
+uint32_t AstView::token_symbol(size_t i) const {
+    return this->token_symbols[i];
+}
+
+const AstFileBody& AstView::unparsed_body(size_t i) const {
+    return this->bodies[i];
+}
+
+MappedAst::MappedAst(const std::filesystem::path& path) {
+    this->mapping        = nullptr;
+    this->mapping_length = 0;
+    std::string_view data;
+#ifdef RAJ_HAVE_MMAP
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if(descriptor < 0) {
+        LOG_DEBUG("Unable to open binary AST " << path)
+        return;
+    }
+    struct stat info {};
+    if(fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* pages = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if(pages != MAP_FAILED) {
+            this->mapping        = pages;
+            this->mapping_length = info.st_size;
+            data = std::string_view(static_cast<const char*>(pages), info.st_size);
+        }
+    }
+    close(descriptor);
+#endif
+    if(this->mapping == nullptr) {
+        std::ifstream file(path, std::ios::binary);
+        if(!file) {
+            LOG_DEBUG("Unable to open binary AST " << path)
+            return;
+        }
+        this->owned = std::make_unique<std::string>(std::istreambuf_iterator<char>(file),
+                                                    std::istreambuf_iterator<char>());
+        data        = *this->owned;
+    }
+    this->ast = AstView(data);
+}
+
+MappedAst::~MappedAst() {
+#ifdef RAJ_HAVE_MMAP
+    if(this->mapping != nullptr) {
+        munmap(this->mapping, this->mapping_length);
+    }
+#endif
+}
+
+const AstView& MappedAst::view() const {
+    return this->ast;
+}
+
+uint64_t source_check(std::string_view source) {
+    return SymbolTable::hash(source, 0xc2b2ae3d27d4eb4full);
+}
+
+std::string serialize_ast(const Tree& ast, uint64_t key, const TokenBuffer* lexemes) {
+    StringTable strings;
+    TypeList    types;
+
+    std::vector<AstFileNode> nodes(ast.size());
+    for(vertex_t vertex : ast.vertex_set()) {
+        const ASTNode& node   = ast[vertex];
+        AstFileNode&   record = nodes[vertex];
+        record.node_class     = node.node_class;
+        record.sub_type       = node.sub_type;
+        record.reserved       = 0;
+        record.name           = strings.add(node.name);
+        record.symbol         = strings.add_symbol(node.symbol);
+        record.type           = types.add(node.type);
+        record.offset         = node.location.offset;
+    }
+
+    std::vector<uint8_t>  token_kinds;
+    std::vector<uint32_t> token_symbols;
+    const uint32_t*       token_offsets = nullptr;
+    const uint32_t*       token_lengths = nullptr;
+    if(lexemes != nullptr) {
+        token_offsets = lexemes->offsets.data();
+        token_lengths = lexemes->lengths.data();
+        token_kinds.resize(lexemes->size());
+        token_symbols.resize(lexemes->size());
+        for(size_t i = 0; i < lexemes->size(); i++) {
+            token_kinds[i]   = static_cast<uint8_t>(lexemes->kinds[i]);
+            token_symbols[i] = strings.add_symbol(lexemes->symbols[i]);
+        }
+    }
+
+    // Sorted so the same tree always gives the same bytes
+    std::vector<AstFileBody> bodies;
+    for(const auto& [function, open] : ast.unparsed_bodies) {
+        bodies.push_back(AstFileBody{function, open.offset});
+    }
+    std::sort(bodies.begin(), bodies.end(), [](const AstFileBody& a, const AstFileBody& b) {
+        return a.function < b.function;
+    });
+
+    SectionWriter writer;
+    AstFileHeader header{};
+    std::memcpy(header.magic, ast_file_magic, sizeof(ast_file_magic));
+    header.version         = ast_file_version;
+    header.byte_order      = ast_file_byte_order;
+    header.key             = key;
+    header.source_length   = ast.source.length();
+    header.source_check    = source_check(ast.source);
+    header.nodes           = writer.append(nodes);
+    header.parents         = writer.append(ast.parents);
+    header.first_children  = writer.append(ast.first_children);
+    header.last_children   = writer.append(ast.last_children);
+    header.next_siblings   = writer.append(ast.next_siblings);
+    header.declarations    = writer.append(ast.declarations);
+    header.strings         = writer.append(strings.strings);
+    header.string_data     = writer.append(strings.data.data(), strings.data.size());
+    header.types           = writer.append(types.types);
+    header.operands        = writer.append(types.operands);
+    header.token_kinds     = writer.append(token_kinds);
+    header.token_offsets   = writer.append(token_offsets, token_kinds.size());
+    header.token_lengths   = writer.append(token_lengths, token_kinds.size());
+    header.token_symbols   = writer.append(token_symbols);
+    header.unparsed_bodies = writer.append(bodies);
+    std::memcpy(writer.out.data(), &header, sizeof(header));
+    return std::move(writer.out);
+}
+
+bool emit_ast(const Tree& ast, const std::filesystem::path& path) {
+    std::string   data = serialize_ast(ast, SymbolTable::hash(ast.source));
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if(!file) {
+        LOG_ERROR("Unable to write binary AST " << path)
+        return false;
+    }
+    LOG_INFO("Binary AST in " << path)
+    return true;
+}
+
+Tree load_tree(const AstView& view, const SourceCode& source, TokenBuffer& lexemes) {
+    std::string_view document = source.raw_document;
+    Tree             tree;
+    if(view.header().source_length != document.length()) {
+        LOG_ERROR("Binary AST of a " << view.header().source_length
+                                     << " byte source does not match " << source.path)
+        return tree;
+    }
+    // Names spelled at their node's offset in the source are views of it like a parsed tree's,
+    // the others are copied into the tree's arena. Each string is copied and interned at most
+    // once, on first use.
+    std::vector<std::string_view> names(view.header().strings.count);
+    std::vector<Symbol>           symbols(view.header().strings.count, no_symbol);
+    auto                          name_of = [&](uint32_t index, uint32_t offset) {
+        std::string_view text = view.string(index);
+        if(document.compare(offset, text.length(), text) == 0) {
+            return document.substr(offset, text.length());
+        }
+        if(names[index].data() == nullptr) {
+            names[index] = tree.store(view.string(index));
+        }
+        return names[index];
+    };
+    auto symbol_of = [&](uint32_t index) {
+        if(index == ast_file_none) {
+            return no_symbol;
+        }
+        if(symbols[index] == no_symbol) {
+            symbols[index] = SymbolTable::current().intern(view.string(index));
+        }
+        return symbols[index];
+    };
+
+    TypeTable&          type_table = TypeTable::current();
+    std::vector<TypeId> types(view.header().types.count);
+    std::vector<TypeId> operands;
+    for(uint32_t i = 0; i < types.size(); i++) {
+        const AstFileType& type = view.type(i);
+        operands.clear();
+        for(uint32_t k = 0; k < type.operand_count; k++) {
+            operands.push_back(types[view.operand(i, k)]);
+        }
+        types[i] = type_table.intern(
+            static_cast<ASTNodeSubType>(type.kind), operands.data(), type.operand_count);
+    }
+
+    size_t count = view.size();
+    tree.nodes.reserve(count);
+    for(vertex_t vertex = 0; vertex < count; vertex++) {
+        const AstFileNode& record = view.node(vertex);
+        ASTNode            node(static_cast<ASTNodeClass>(record.node_class),
+                     static_cast<ASTNodeSubType>(record.sub_type),
+                     name_of(record.name, record.offset),
+                     Location(source.file_id, record.offset),
+                     symbol_of(record.symbol));
+        node.type = record.type == ast_file_none ? no_type : types[record.type];
+        tree.nodes.push_back(node);
+    }
+    tree.parents.resize(count);
+    tree.first_children.resize(count);
+    tree.last_children.resize(count);
+    tree.next_siblings.resize(count);
+    tree.declarations.resize(count);
+    for(vertex_t vertex = 0; vertex < count; vertex++) {
+        tree.parents[vertex]        = view.parent(vertex);
+        tree.first_children[vertex] = view.first_child(vertex);
+        tree.last_children[vertex]  = view.last_child(vertex);
+        tree.next_siblings[vertex]  = view.next_sibling(vertex);
+        tree.declarations[vertex]   = view.declaration(vertex);
+    }
+    for(size_t i = 0; i < view.header().unparsed_bodies.count; i++) {
+        const AstFileBody& body = view.unparsed_body(i);
+        tree.unparsed_bodies.emplace(body.function, Location(source.file_id, body.offset));
+    }
+    tree.source = document;
+
+    TokenBuffer tokens(source);
+    tokens.reserve(view.token_count());
+    for(size_t i = 0; i < view.token_count(); i++) {
+        tokens.push_back(view.token_kind(i),
+                         view.token_offset(i),
+                         view.token_length(i),
+                         symbol_of(view.token_symbol(i)));
+    }
+    lexemes = std::move(tokens);
+    return tree;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "AST.hpp"
+#include "Lexer.hpp"
+
+// Binary AST files. A header, then arrays each starting at an 8 byte aligned offset from the start
+// of the file. Nodes refer to each other by index and to strings and types through tables in the
+// file, so a mapped file is walked in place without building anything.
+constexpr char     ast_file_magic[8]    = {'R', 'A', 'J', 'A', 'S', 'T', '\0', '\0'};
+constexpr uint32_t ast_file_version     = 3;
+constexpr uint32_t ast_file_byte_order  = 0x01020304;
+constexpr uint32_t ast_file_none        = UINT32_MAX; // Absent string, type or node
+constexpr char     ast_file_extension[] = ".ast";
+
+class AstFileSection {
+public:
+    uint64_t offset; // From the start of the file
+    uint64_t count; // Elements, not bytes
+};
+
+class AstFileHeader {
+public:
+    char           magic[8];
+    uint32_t       version;
+    uint32_t       byte_order; // ast_file_byte_order as the writer stored it
+    uint64_t       key; // Identity of what was parsed, a hash of the source unless a cache entry
+    uint64_t       source_length;
+    uint64_t       source_check; // source_check() of the source, the key may collide on its own
+    AstFileSection nodes; // AstFileNode
+    AstFileSection parents; // uint32_t node indices, ast_file_none for the root
+    AstFileSection first_children;
+    AstFileSection last_children;
+    AstFileSection next_siblings;
+    AstFileSection declarations;
+    AstFileSection strings; // AstFileString, each name is stored once
+    AstFileSection string_data; // char
+    AstFileSection types; // AstFileType, operands come before the types made of them
+    AstFileSection operands; // uint32_t type indices
+    AstFileSection token_kinds; // uint8_t LexemeClass, the token sections are optional
+    AstFileSection token_offsets; // uint32_t
+    AstFileSection token_lengths; // uint32_t
+    AstFileSection token_symbols; // uint32_t string indices
+    AstFileSection unparsed_bodies; // AstFileBody
+};
+
+class AstFileNode {
+public:
+    uint8_t  node_class; // ASTNodeClass
+    uint8_t  sub_type; // ASTNodeSubType
+    uint16_t reserved;
+    uint32_t name; // String index
+    uint32_t symbol; // String index of the interned name, ast_file_none if it has none
+    uint32_t type; // Type index
+    uint32_t offset; // Byte offset of the node in the source
+};
+
+class AstFileString {
+public:
+    uint32_t offset; // Into string_data
+    uint32_t length;
+};
+
+class AstFileType {
+public:
+    uint8_t  kind; // ASTNodeSubType
+    uint8_t  reserved[3];
+    uint32_t first_operand; // Into operands
+    uint32_t operand_count;
+};
+
+class AstFileBody {
+public:
+    uint32_t function; // Node whose body a lazy parse skipped
+    uint32_t offset; // Of the body's CurlL
+};
+
+class AstView {
+public:
+    // Read only view of a binary AST in memory. Making the view checks the header and that every
+    // section lies within the data, the accessors are then plain array reads. Data that is not a
+    // binary AST of this version gives an empty view with damage() saying why, nothing throws.
+    AstView();
+    explicit AstView(std::string_view data);
+
+    [[nodiscard]] const AstFileHeader& header() const;
+    [[nodiscard]] size_t               size() const;
+    [[nodiscard]] const AstFileNode&   node(vertex_t vertex) const;
+    [[nodiscard]] std::string_view     name(vertex_t vertex) const;
+    [[nodiscard]] vertex_t             parent(vertex_t vertex) const;
+    [[nodiscard]] vertex_t             first_child(vertex_t vertex) const;
+    [[nodiscard]] vertex_t             last_child(vertex_t vertex) const;
+    [[nodiscard]] vertex_t             next_sibling(vertex_t vertex) const;
+    [[nodiscard]] vertex_t             declaration(vertex_t vertex) const;
+
+    [[nodiscard]] std::string_view   string(uint32_t index) const;
+    [[nodiscard]] const AstFileType& type(uint32_t index) const;
+    [[nodiscard]] uint32_t           operand(uint32_t type, uint32_t i) const;
+    // Spelling of a type of the file, as TypeTable::to_string spells it
+    [[nodiscard]] std::string        type_name(uint32_t index) const;
+
+    [[nodiscard]] size_t      token_count() const;
+    [[nodiscard]] LexemeClass token_kind(size_t i) const;
+    [[nodiscard]] uint32_t    token_offset(size_t i) const;
+    [[nodiscard]] uint32_t    token_length(size_t i) const;
+    [[nodiscard]] uint32_t    token_symbol(size_t i) const;
+    // Bodies a lazy parse skipped, header().unparsed_bodies.count of them
+    [[nodiscard]] const AstFileBody& unparsed_body(size_t i) const;
+
+    // Check every index stored in the file and that the links form a forest without cycles. Files
+    // that may be damaged are validated once before they are walked, the accessors trust them.
+    // False, with damage() saying what is wrong, for a damaged file.
+    [[nodiscard]] bool        validate() const;
+    // What the constructor or validate found wrong with the data, nullptr if nothing
+    [[nodiscard]] const char* damage() const;
+
+private:
+    std::string_view     data;
+    const AstFileHeader* head;
+    const AstFileNode*   nodes;
+    const uint32_t*      links[5]; // parents, first and last children, next siblings, declarations
+    const AstFileString* strings;
+    const char*          string_data;
+    const AstFileType*   types;
+    const uint32_t*      operands;
+    const uint8_t*       token_kinds;
+    const uint32_t*      token_offsets;
+    const uint32_t*      token_lengths;
+    const uint32_t*      token_symbols;
+    const AstFileBody*   bodies;
+    mutable const char*  problem;
+
+    template <typename T> const T* section(const AstFileSection& section) const;
+    bool damaged(const char* what) const;
+    void append_type_name(uint32_t index, std::string& out) const;
+};
+
+class MappedAst {
+public:
+    // A binary AST file mapped into memory for the life of the object, read into memory where
+    // files cannot be mapped. The view is empty, with damage() saying why, if the file cannot be
+    // read or is not a binary AST.
+    explicit MappedAst(const std::filesystem::path& path);
+    MappedAst(const MappedAst&)            = delete;
+    MappedAst& operator=(const MappedAst&) = delete;
+    ~MappedAst();
+
+    [[nodiscard]] const AstView& view() const;
+
+private:
+    void*                        mapping;
+    size_t                       mapping_length;
+    std::unique_ptr<std::string> owned;
+    AstView                      ast;
+};
+
+// Hash of a source independent of SymbolTable::hash, a file is only taken for a source when its
+// length and both hashes match
+uint64_t    source_check(std::string_view source);
+// Binary AST of a tree, with the tokens it was parsed from if lexemes is given
+std::string serialize_ast(const Tree& ast, uint64_t key, const TokenBuffer* lexemes = nullptr);
+// Write the binary AST of a tree keyed by a hash of its source, returns false if the file could not
+// be written
+bool        emit_ast(const Tree& ast, const std::filesystem::path& path);
+// Build a tree, and the tokens if the file holds them, from a validated view of the binary AST
+// of source. Types and symbols are interned in this process. Names found at their node's offset
+// in source are views of it, only the others are copied to the tree's arena. A view of a source of
+// another length gives an empty tree.
+Tree        load_tree(const AstView& view, const SourceCode& source, TokenBuffer& lexemes);
@@ -0,0 +1,160 @@
+#include "Cache.hpp"
+#include "BinaryAST.hpp"
+#include "Profile.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+namespace {
+
+constexpr char cache_ending[] = ".rajc";
+
+} // namespace
+
+ParseCache::ParseCache(const std::filesystem::path& directory, uint64_t max_bytes) {
+    this->directory  = directory;
+    this->max_bytes  = max_bytes;
+    this->hit_count  = 0;
+    this->miss_count = 0;
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if(error) {
+        // Every load is then a miss and every store fails with a warning
+        LOG_ERROR("Unable to create the cache directory " << directory << ": " << error.message())
+    }
+}
+
+ParseCache::~ParseCache() = default;
+
+uint64_t ParseCache::key(const SourceCode& source, const ParseOptions& options) {
+    // Anything that changes what is produced for a document is part of the key
+    std::ostringstream salt;
+    salt << RAJ_VERSION << '/' << ast_file_version << '/' << options.lazy_bodies;
+    return SymbolTable::hash(source.raw_document) ^ (SymbolTable::hash(salt.str()) * 31);
+}
+
+std::filesystem::path ParseCache::entry_path(uint64_t key) const {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return this->directory / (std::string(name) + cache_ending);
+}
+
+bool ParseCache::load(const SourceCode&   source,
+                      const ParseOptions& options,
+                      TokenBuffer&        lexemes,
+                      Tree&               ast) {
+    PROFILE_SCOPE(probe, "cache_load");
+    uint64_t              entry_key = key(source, options);
+    std::filesystem::path path      = this->entry_path(entry_key);
+    std::error_code       error;
+    if(!std::filesystem::exists(path, error)) {
+        this->miss_count++;
+        return false;
+    }
+    // The entry is mapped and checked in place, then turned into a tree of this process
+    MappedAst      entry(path);
+    const AstView& view   = entry.view();
+    const char*    damage = nullptr;
+    if(!view.validate()) {
+        damage = view.damage();
+    }
+    else if(view.header().key != entry_key ||
+            view.header().source_length != source.raw_document.length() ||
+            view.header().source_check != source_check(source.raw_document)) {
+        // The key is only 64 bits, a colliding source must not get the tokens of another
+        damage = "it is for a different source";
+    }
+    if(damage != nullptr) {
+        // A damaged entry is a miss, storing the fresh result replaces it
+        LOG_WARNING("Ignoring cache entry " << path << ": " << damage)
+        this->miss_count++;
+        return false;
+    }
+    ast = load_tree(view, source, lexemes);
+    PROFILE_COUNT(probe, bytes, view.header().source_length);
+    PROFILE_COUNT(probe, tokens, lexemes.size());
+    PROFILE_COUNT(probe, nodes, ast.size());
+    // Reading an entry makes it the most recently used
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    this->hit_count++;
+    return true;
+}
+
+void ParseCache::store(const SourceCode&   source,
+                       const ParseOptions& options,
+                       const TokenBuffer&  lexemes,
+                       const Tree&         ast) {
+    PROFILE_SCOPE(probe, "cache_store");
+    PROFILE_COUNT(probe, nodes, ast.size());
+    uint64_t              entry_key = key(source, options);
+    std::filesystem::path path      = this->entry_path(entry_key);
+    // Written aside and renamed into place so readers never see half an entry
+    std::ostringstream temporary_name;
+    temporary_name << path.string() << '.' << std::this_thread::get_id() << ".tmp";
+    std::filesystem::path temporary(temporary_name.str());
+    std::string           data = serialize_ast(ast, entry_key, &lexemes);
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if(!file) {
+            LOG_WARNING("Unable to write cache entry " << temporary)
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if(error) {
+        LOG_WARNING("Unable to write cache entry " << path << ": " << error.message())
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+void ParseCache::evict() {
+    class Entry {
+    public:
+        std::filesystem::path           path;
+        uint64_t                        size;
+        std::filesystem::file_time_type used;
+    };
+    std::vector<Entry> entries;
+    uint64_t           total = 0;
+    std::error_code    error;
+    for(const auto& file : std::filesystem::directory_iterator(this->directory, error)) {
+        if(file.path().extension() != cache_ending || !file.is_regular_file(error)) {
+            continue;
+        }
+        uint64_t size = file.file_size(error);
+        entries.push_back({file.path(), size, file.last_write_time(error)});
+        total += size;
+    }
+    if(total <= this->max_bytes) {
+        return;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.used < b.used;
+    });
+    size_t removed = 0;
+    for(const Entry& entry : entries) {
+        if(total <= this->max_bytes) {
+            break;
+        }
+        if(std::filesystem::remove(entry.path, error)) {
+            total -= entry.size;
+            removed++;
+        }
+    }
+    LOG_INFO("Evicted " << removed << " cache entries, " << total << " bytes remain")
+}
+
+size_t ParseCache::hits() const {
+    return this->hit_count;
+}
+
+size_t ParseCache::misses() const {
+    return this->miss_count;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "AST.hpp"
+#include "Lexer.hpp"
+
+#ifndef RAJ_VERSION
+#define RAJ_VERSION "dev"
+#endif
+
+class ParseCache {
+public:
+    // On disk cache of the tokens and tree of each source, content addressed by a hash of the
+    // document, the compiler version and the parse options. Every entry is a binary AST file of
+    // its own, so files compiled in parallel never share one. Reading an entry refreshes its
+    // modification time, once the directory outgrows max_bytes the least recently used entries
+    // are removed.
+    ParseCache(const std::filesystem::path& directory, uint64_t max_bytes);
+    ~ParseCache();
+
+    // False on a miss or a damaged entry, lexemes and ast are only assigned on a hit
+    bool load(const SourceCode&   source,
+              const ParseOptions& options,
+              TokenBuffer&        lexemes,
+              Tree&               ast);
+    void store(const SourceCode&   source,
+               const ParseOptions& options,
+               const TokenBuffer&  lexemes,
+               const Tree&         ast);
+    // Remove the least recently used entries until the cache fits in max_bytes
+    void evict();
+
+    [[nodiscard]] size_t hits() const;
+    [[nodiscard]] size_t misses() const;
+
+    static uint64_t key(const SourceCode& source, const ParseOptions& options);
+
+private:
+    std::filesystem::path directory;
+    uint64_t              max_bytes;
+    std::atomic<size_t>   hit_count;
+    std::atomic<size_t>   miss_count;
+
+    [[nodiscard]] std::filesystem::path entry_path(uint64_t key) const;
+};
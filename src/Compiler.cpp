@@ -0,0 +1,236 @@
+#include "Compiler.hpp"
+#include "BinaryAST.hpp"
+#include "Parallel.hpp"
+#include "Profile.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+std::vector<std::filesystem::path> collect_source_files(const std::vector<std::string>& inputs) {
+    // Expand directories into the .raj/.jar files beneath them. Files from a directory are sorted
+    // so that the compile order, and with it the order of the output, never depends on the
+    // file system.
+    std::vector<std::filesystem::path> source_files;
+    std::set<std::filesystem::path>    seen;
+    for(const auto& input : inputs) {
+        std::filesystem::path path(input);
+        if(!std::filesystem::is_directory(path)) {
+            if(seen.insert(path.lexically_normal()).second) {
+                source_files.push_back(path);
+            }
+            continue;
+        }
+        std::vector<std::filesystem::path> found;
+        for(const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+            auto extension = entry.path().extension().string();
+            if(entry.is_regular_file() && (extension == ".raj" || extension == ".jar")) {
+                found.push_back(entry.path());
+            }
+        }
+        if(found.empty()) {
+            LOG_WARNING("No .raj or .jar files in " << path.string())
+        }
+        std::sort(found.begin(), found.end());
+        for(const auto& file : found) {
+            if(seen.insert(file.lexically_normal()).second) {
+                source_files.push_back(file);
+            }
+        }
+    }
+    return source_files;
+}
+
+CompilerContext::CompilerContext(CompilerOptions options, std::ostream& diagnostics) {
+    this->compile_options = std::move(options);
+    this->diagnostics     = &diagnostics;
+    if(!this->compile_options.cache_directory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(this->compile_options.cache_directory, error);
+        if(error) {
+            LOG_ERROR("Unable to create the cache directory "
+                      << this->compile_options.cache_directory << ": " << error.message()
+                      << ", compiling without the cache")
+        }
+        else {
+            this->parse_cache = std::make_unique<ParseCache>(this->compile_options.cache_directory,
+                                                             this->compile_options.cache_bytes);
+        }
+    }
+}
+
+CompilerContext::~CompilerContext() = default;
+
+CompilerContext::Scope::Scope(CompilerContext& context) {
+    this->outer_symbols  = SymbolTable::use(&context.symbol_table);
+    this->outer_types    = TypeTable::use(&context.type_table);
+    this->outer_memory   = currentArenaResource;
+    currentArenaResource = context.compile_options.memory;
+}
+
+CompilerContext::Scope::~Scope() {
+    SymbolTable::use(this->outer_symbols);
+    TypeTable::use(this->outer_types);
+    currentArenaResource = this->outer_memory;
+}
+
+const CompilerOptions& CompilerContext::options() const {
+    return this->compile_options;
+}
+
+SymbolTable& CompilerContext::symbols() {
+    return this->symbol_table;
+}
+
+TypeTable& CompilerContext::types() {
+    return this->type_table;
+}
+
+ParseCache* CompilerContext::cache() {
+    return this->parse_cache.get();
+}
+
+std::vector<CompileResult>
+CompilerContext::compile(const std::vector<std::filesystem::path>& files) {
+    std::vector<CompileResult> results(files.size());
+    {
+        std::vector<SourceCode> sources = read_raw_file(files);
+        for(size_t i = 0; i < sources.size(); i++) {
+            results[i].source = std::move(sources[i]);
+        }
+    }
+    const CompilerOptions& options = this->compile_options;
+    if(!options.emit_path.empty() && files.size() > 1) {
+        std::filesystem::create_directories(options.emit_path);
+    }
+
+    // Every file is lexed and parsed independently, results are kept by file index so the merge
+    // below is deterministic regardless of which worker finished first
+    std::vector<std::ostringstream> diagnostics(files.size());
+    parallel_for(files.size(), options.jobs, [&](size_t i) {
+        Scope         scope(*this);
+        std::ostream* outer_capture     = currentLogCapture;
+        Diagnostics*  outer_diagnostics = currentDiagnostics;
+        currentLogCapture               = &diagnostics[i];
+        currentDiagnostics              = &results[i].diagnostics;
+        PROFILE_FILE(profile_file, results[i].source.path);
+        results[i].success = this->compile_file(results[i].source, results[i].ast, options.jobs,
+                                                files.size());
+        currentLogCapture  = outer_capture;
+        currentDiagnostics = outer_diagnostics;
+    });
+
+    if(this->parse_cache) {
+        LOG_INFO("Parse cache: " << this->parse_cache->hits() << " hits, "
+                                 << this->parse_cache->misses() << " misses")
+        this->parse_cache->evict();
+    }
+    // After anything already logged, the sink is often the console too
+    Logger::global().flush();
+    for(const std::ostringstream& file_diagnostics : diagnostics) {
+        *this->diagnostics << file_diagnostics.str();
+    }
+    return results;
+}
+
+CompileResult CompilerContext::compile(SourceCode source) {
+    CompileResult result;
+    result.source = std::move(source);
+    std::ostringstream captured;
+    {
+        Scope         scope(*this);
+        std::ostream* outer_capture     = currentLogCapture;
+        Diagnostics*  outer_diagnostics = currentDiagnostics;
+        currentLogCapture               = &captured;
+        currentDiagnostics              = &result.diagnostics;
+        PROFILE_FILE(profile_file, result.source.path);
+        result.success =
+            this->compile_file(result.source, result.ast, this->compile_options.jobs, 1);
+        currentLogCapture  = outer_capture;
+        currentDiagnostics = outer_diagnostics;
+    }
+    Logger::global().flush();
+    *this->diagnostics << captured.str();
+    return result;
+}
+
+bool CompilerContext::compile_file(const SourceCode& source,
+                                   Tree&             ast,
+                                   size_t            jobs,
+                                   size_t            file_count) {
+    const CompilerOptions& options = this->compile_options;
+    ParseCache*            cache   = this->parse_cache.get();
+    if(!source.load_error.empty()) {
+        report_error(Location(source.file_id, 0),
+                     "Unable to read ",
+                     source.path.string(),
+                     ": ",
+                     source.load_error);
+        return false;
+    }
+    // Threads not needed for other files help with chunked lexing of this one when it is at
+    // least two chunks long, otherwise the parser pulls tokens from the lexer and the token
+    // vector is never materialised
+    size_t      spare_jobs = std::max<size_t>(1, jobs / std::max<size_t>(file_count, 1));
+    bool        chunked = spare_jobs > 1 && source.raw_document.length() >= 2 * min_lex_chunk;
+    TokenBuffer lexemes;
+    if(cache && cache->load(source, options.parse, lexemes, ast)) {
+        // Unchanged since it was cached, it is neither lexed nor parsed
+    }
+    else if(chunked || cache) {
+        // The cache keeps the tokens as well, so they are materialised for it
+        lexemes = chunked ? lex_file_parallel(source, spare_jobs) : lex_file(source);
+        ast     = generate_ast(lexemes, options.parse);
+        // Trees with errors are not cached, a hit never has anything to report
+        if(cache && !currentDiagnostics->has_errors()) {
+            cache->store(source, options.parse, lexemes, ast);
+        }
+    }
+    else {
+        ast = generate_ast(source, options.parse);
+    }
+    if(options.parse.lazy_bodies) {
+        // Files without a main are libraries, their bodies wait for a caller
+        for(vertex_t function = ast.first_child(0); function != no_vertex;
+            function          = ast.next_sibling(function)) {
+            if(ast[function].node_class == ASTNodeClass::Function &&
+               ast[function].name == "main") {
+                parse_reachable(ast, function);
+            }
+        }
+    }
+    if(currentDiagnostics->has_errors()) {
+        // Already reported, nothing is emitted for a file with errors
+        return false;
+    }
+    if(options.emit_format.empty()) {
+        return true;
+    }
+
+    // Only done when asked for, the default compile does no dump work at all
+    std::filesystem::path output = source.path.filename();
+    output += options.emit_format == "bin" ? ast_file_extension : "." + options.emit_format;
+    if(options.emit_path.empty()) {
+        output = source.path.parent_path() / output;
+    }
+    else {
+        output = file_count == 1 ? options.emit_path : options.emit_path / output;
+    }
+    DumpOptions file_options = options.dump;
+    if(!options.emit_root.empty()) {
+        file_options.root = no_vertex;
+        for(vertex_t vertex : ast.vertex_set()) {
+            if(ast[vertex].node_class == ASTNodeClass::Function &&
+               ast[vertex].name == options.emit_root) {
+                file_options.root = vertex;
+                break;
+            }
+        }
+    }
+    if(file_options.root == no_vertex) {
+        LOG_WARNING(source.path.string() << " has no function " << options.emit_root)
+        return true;
+    }
+    return dump_ast(ast, options.emit_format, output, file_options);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "AST.hpp"
+#include "Cache.hpp"
+#include "Diagnostics.hpp"
+#include "Dump.hpp"
+#include "Lexer.hpp"
+#include "Symbols.hpp"
+#include "Types.hpp"
+
+class CompilerOptions {
+public:
+    // Everything that decides what one compiler context produces
+    ParseOptions          parse;
+    size_t                jobs = 1; // Files compiled at once, spare jobs lex large files in chunks
+    std::filesystem::path cache_directory; // No parse cache when empty
+    uint64_t              cache_bytes = uint64_t(512) << 20;
+    std::string           emit_format; // dot, json or bin, nothing is written when empty
+    std::filesystem::path emit_path; // Next to each source when empty
+    std::string           emit_root; // Function whose subtree dot and json write, all when empty
+    DumpOptions           dump;
+    // Where the arenas of the trees get their memory, the default resource when null
+    std::pmr::memory_resource* memory = nullptr;
+};
+
+class CompileResult {
+public:
+    // Everything a context produced for one file. The tree refers to the source and to the
+    // tables of the context that made it, after errors it holds the statements without any.
+    SourceCode  source;
+    Tree        ast;
+    Diagnostics diagnostics; // Errors in the source, they are written to the sink as well
+    bool        success = false;
+};
+
+class CompilerContext {
+public:
+    // One compilation session, reentrant and embeddable. A context owns its options, the sink its
+    // diagnostics go to, the symbol and type tables its trees refer to, its parse cache and the
+    // memory resource of its arenas. Contexts share no mutable state, so any number of them may
+    // compile at the same time on different threads. The logger, the profiler, the allocation
+    // tracker and the file table stay process wide.
+    //
+    // The file table (FileTable::global) resolves every Location to a path, line and column, so
+    // its entries outlive the context and are never dropped: diagnostics and trees stay printable
+    // after the context is gone. It holds the path and a 4 byte line start per line of each
+    // distinct content of each file compiled. A long running embedder that recompiles files as
+    // they change grows it by that much per change.
+    CompilerContext(CompilerOptions options, std::ostream& diagnostics);
+    CompilerContext(const CompilerContext&)            = delete;
+    CompilerContext& operator=(const CompilerContext&) = delete;
+    ~CompilerContext();
+
+    // Compile every file and write their diagnostics to the sink in the order of the files,
+    // whichever finished first. Failures are reported per file, nothing is thrown.
+    std::vector<CompileResult> compile(const std::vector<std::filesystem::path>& files);
+    // Compile a source already in memory
+    CompileResult              compile(SourceCode source);
+
+    class Scope {
+    public:
+        // Makes the context current on this thread for the life of the scope, so functions that
+        // intern or look up names and types use its tables. Needed to work on the trees of a
+        // context outside of compile.
+        explicit Scope(CompilerContext& context);
+        Scope(const Scope&)            = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope();
+
+    private:
+        SymbolTable*               outer_symbols;
+        TypeTable*                 outer_types;
+        std::pmr::memory_resource* outer_memory;
+    };
+
+    [[nodiscard]] const CompilerOptions& options() const;
+    [[nodiscard]] SymbolTable&           symbols();
+    [[nodiscard]] TypeTable&             types();
+    // Null when the options have no cache directory
+    [[nodiscard]] ParseCache*            cache();
+
+private:
+    CompilerOptions             compile_options;
+    std::ostream*               diagnostics;
+    SymbolTable                 symbol_table;
+    TypeTable                   type_table;
+    std::unique_ptr<ParseCache> parse_cache;
+
+    // Lex, parse and dump one file on this thread, diagnostics go to the current log capture and
+    // errors in the source to currentDiagnostics
+    bool compile_file(const SourceCode& source, Tree& ast, size_t jobs, size_t file_count);
+};
+
+// Expand directories into the .raj/.jar files beneath them, sorted so that the order of the files
+// never depends on the file system. Files named twice are compiled once.
+std::vector<std::filesystem::path> collect_source_files(const std::vector<std::string>& inputs);
@@ -0,0 +1,35 @@
+#include "Diagnostics.hpp"
+#include "logging.hpp"
+
+void Diagnostics::report(const Location& location, std::string message) {
+    this->count++;
+    if(this->kept.size() < max_errors) {
+        this->kept.push_back(Diagnostic{location, std::move(message)});
+    }
+}
+
+bool Diagnostics::has_errors() const {
+    return this->count > 0;
+}
+
+size_t Diagnostics::error_count() const {
+    return this->count;
+}
+
+bool Diagnostics::limit_reached() const {
+    return this->count >= max_errors;
+}
+
+const std::vector<Diagnostic>& Diagnostics::errors() const {
+    return this->kept;
+}
+
+void record_error(const Location& location, std::string message) {
+    LOG_ERROR(message << " at " << location.to_string())
+    if(currentDiagnostics != nullptr) {
+        currentDiagnostics->report(location, std::move(message));
+        if(currentDiagnostics->error_count() == Diagnostics::max_errors) {
+            LOG_ERROR("Too many errors in " << location.file().string() << ", stopping")
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Lexer.hpp"
+
+class Diagnostic {
+public:
+    Location    location;
+    std::string message;
+};
+
+class Diagnostics {
+public:
+    // Errors found in one file. Malformed input never throws: the lexer turns text it cannot
+    // classify into Error tokens, the parser reports what it expected, returns no_vertex, no_type
+    // or false up to the enclosing statement and resumes after the next ; or before the next }.
+    // Parsing stops once max_errors are reported, later errors are only counted.
+    static constexpr size_t max_errors = 100;
+
+    void report(const Location& location, std::string message);
+
+    [[nodiscard]] bool                           has_errors() const;
+    [[nodiscard]] size_t                         error_count() const;
+    [[nodiscard]] bool                           limit_reached() const;
+    [[nodiscard]] const std::vector<Diagnostic>& errors() const;
+
+private:
+    std::vector<Diagnostic> kept;
+    size_t                  count = 0;
+};
+
+// Errors found on this thread are recorded here as well as logged, only logged when it is null
+inline thread_local Diagnostics* currentDiagnostics = nullptr;
+
+void record_error(const Location& location, std::string message);
+
+// Log and record an error at location, the parts are streamed into the message
+template <typename... Parts>
+void report_error(const Location& location, const Parts&... parts) {
+    if(currentDiagnostics != nullptr && currentDiagnostics->limit_reached()) {
+        // Counted without building the message
+        currentDiagnostics->report(location, std::string());
+        return;
+    }
+    std::ostringstream message;
+    (message << ... << parts);
+    record_error(location, message.str());
+}
+
+// Whether the current file has so many errors that parsing it should stop
+inline bool error_limit_reached() {
+    return currentDiagnostics != nullptr && currentDiagnostics->limit_reached();
+}
@@ -0,0 +1,139 @@
+#include "Dump.hpp"
+#include "BinaryAST.hpp"
+#include "Profile.hpp"
+#include "logging.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+template <typename Enter, typename Leave>
+void walk(const Tree& ast, const DumpOptions& options, Enter&& enter, Leave&& leave) {
+    // Depth first without recursion so deep trees cannot overflow the stack. Each frame remembers
+    // the next child of its node to visit.
+    class Frame {
+    public:
+        vertex_t vertex;
+        vertex_t next_child;
+        uint32_t depth;
+    };
+    if(options.root >= ast.size()) {
+        LOG_ERROR("Dump root " << options.root << " is not in a tree of " << ast.size() << " nodes")
+        throw std::runtime_error("Dump root out of range");
+    }
+    std::vector<Frame> stack;
+    auto               push = [&](vertex_t vertex, uint32_t depth, bool first) {
+        bool expand = depth < options.max_depth;
+        enter(vertex, first, !expand && ast.first_child(vertex) != no_vertex);
+        stack.push_back(Frame{vertex, expand ? ast.first_child(vertex) : no_vertex, depth});
+    };
+    push(options.root, 0, true);
+    while(!stack.empty()) {
+        Frame frame = stack.back();
+        if(frame.next_child == no_vertex) {
+            leave(frame.vertex);
+            stack.pop_back();
+            continue;
+        }
+        stack.back().next_child = ast.next_sibling(frame.next_child);
+        push(frame.next_child, frame.depth + 1, frame.next_child == ast.first_child(frame.vertex));
+    }
+}
+
+void write_escaped(std::ostream& out, std::string_view text) {
+    // Escapes shared by graphviz and JSON strings
+    for(char ch : text) {
+        if(ch == '"' || ch == '\\') {
+            out << '\\' << ch;
+        }
+        else if(static_cast<unsigned char>(ch) < 0x20) {
+            out << (ch == '\n' ? "\\n" : " ");
+        }
+        else {
+            out << ch;
+        }
+    }
+}
+
+} // namespace
+
+void write_dot(const Tree& ast, std::ostream& out, const DumpOptions& options) {
+    out << "digraph G {\n";
+    walk(
+        ast,
+        options,
+        [&](vertex_t vertex, bool, bool truncated) {
+            const ASTNode& node = ast[vertex];
+            out << vertex << " [label=\"";
+            write_escaped(out, node.name);
+            out << "\", fillcolor=\"" << node._get_graph_color() << "\", shape=\""
+                << node._get_graph_shape() << "\", style=\""
+                << (truncated ? "filled,dashed" : "filled") << "\"];\n";
+            if(vertex != options.root) {
+                out << ast.parent(vertex) << " -> " << vertex << ";\n";
+            }
+        },
+        [](vertex_t) {});
+    out << "}\n";
+}
+
+void write_json(const Tree& ast, std::ostream& out, const DumpOptions& options) {
+    FileTable& files = FileTable::global();
+    TypeTable& types = TypeTable::current();
+    walk(
+        ast,
+        options,
+        [&](vertex_t vertex, bool first, bool truncated) {
+            const ASTNode& node = ast[vertex];
+            auto [line, column] = files.line_column(node.location.file_id, node.location.offset);
+            out << (first ? "" : ",") << "{\"id\":" << vertex << ",\"class\":\""
+                << magic_enum::enum_name(node.node_class) << "\",\"sub_type\":\""
+                << magic_enum::enum_name(node.sub_type) << "\",\"name\":\"";
+            write_escaped(out, node.name);
+            out << "\",\"line\":" << line << ",\"column\":" << column;
+            if(node.type != no_type) {
+                out << ",\"type\":\"";
+                write_escaped(out, types.to_string(node.type));
+                out << '"';
+            }
+            if(ast.declaration(vertex) != no_vertex) {
+                out << ",\"declaration\":" << ast.declaration(vertex);
+            }
+            if(truncated) {
+                out << ",\"truncated\":true";
+            }
+            out << ",\"children\":[";
+        },
+        [&](vertex_t) { out << "]}"; });
+    out << '\n';
+}
+
+bool dump_ast(const Tree&                  ast,
+              std::string_view             format,
+              const std::filesystem::path& path,
+              const DumpOptions&           options) {
+    PROFILE_SCOPE(probe, "dump_ast");
+    PROFILE_COUNT(probe, nodes, ast.size());
+    if(format == "bin") {
+        return emit_ast(ast, path);
+    }
+    if(format != "dot" && format != "json") {
+        LOG_ERROR("Unknown AST format " << format)
+        return false;
+    }
+    std::ofstream out(path);
+    if(format == "dot") {
+        write_dot(ast, out, options);
+    }
+    else {
+        write_json(ast, out, options);
+    }
+    if(!out) {
+        LOG_ERROR("Unable to write the AST to " << path)
+        return false;
+    }
+    LOG_INFO("AST in " << path)
+    return true;
+}
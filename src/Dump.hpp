@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string_view>
+
+#include "AST.hpp"
+
+class DumpOptions {
+public:
+    vertex_t root      = 0; // Only the subtree below this node is written
+    uint32_t max_depth = UINT32_MAX; // Levels written below root, 0 writes root alone
+};
+
+// Both writers walk the tree in place and stream straight to out, nodes whose children were cut
+// by the depth limit are marked as truncated
+void write_dot(const Tree& ast, std::ostream& out, const DumpOptions& options = DumpOptions());
+void write_json(const Tree& ast, std::ostream& out, const DumpOptions& options = DumpOptions());
+// Write the tree as "dot", "json" or "bin" to path, the binary AST is always the whole tree.
+// Returns false if the file could not be written.
+bool dump_ast(const Tree&                  ast,
+              std::string_view             format,
+              const std::filesystem::path& path,
+              const DumpOptions&           options = DumpOptions());
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "Lexer.hpp"
+
+enum ASTNodeSubType : uint8_t {
+    // i1, the unsigned u1 sits with the other unsigned integers
+    boolean,
+
+    i8,
+    i16,
+    i32,
+    i64,
+    i128,
+
+    u1,
+    u8,
+    u16,
+    u32,
+    u64,
+    u128,
+
+    f32,
+    f64,
+
+    array,
+    tuple,
+    map,
+
+    func,
+    none,
+};
+
+class KeywordSpec {
+public:
+    // Single source of truth for reserved words, shared by the lexer and the parser
+    std::string_view name;
+    LexemeClass      lexeme_type;
+    ASTNodeSubType   sub_type;
+};
+
+// clang-format off
+inline constexpr std::array<KeywordSpec, 22> keyword_specs = {{
+    {"let",    LexemeClass::Declaration,  ASTNodeSubType::none},
+    {"if",     LexemeClass::Conditional,  ASTNodeSubType::none},
+    {"else",   LexemeClass::Conditional,  ASTNodeSubType::none},
+    {"return", LexemeClass::Return,       ASTNodeSubType::none},
+    {"as",     LexemeClass::Cast,         ASTNodeSubType::none},
+    {"func",   LexemeClass::Function,     ASTNodeSubType::func},
+    {"array",  LexemeClass::Array,        ASTNodeSubType::array},
+    {"map",    LexemeClass::Map,          ASTNodeSubType::map},
+
+    // 1 bit integers are booleans, signed and unsigned ones are distinct types like the wider ones
+    {"i1",     LexemeClass::IntegerType,  ASTNodeSubType::boolean},
+    {"i8",     LexemeClass::IntegerType,  ASTNodeSubType::i8},
+    {"i16",    LexemeClass::IntegerType,  ASTNodeSubType::i16},
+    {"i32",    LexemeClass::IntegerType,  ASTNodeSubType::i32},
+    {"i64",    LexemeClass::IntegerType,  ASTNodeSubType::i64},
+    {"i128",   LexemeClass::IntegerType,  ASTNodeSubType::i128},
+
+    {"u1",     LexemeClass::UIntegerType, ASTNodeSubType::u1},
+    {"u8",     LexemeClass::UIntegerType, ASTNodeSubType::u8},
+    {"u16",    LexemeClass::UIntegerType, ASTNodeSubType::u16},
+    {"u32",    LexemeClass::UIntegerType, ASTNodeSubType::u32},
+    {"u64",    LexemeClass::UIntegerType, ASTNodeSubType::u64},
+    {"u128",   LexemeClass::UIntegerType, ASTNodeSubType::u128},
+
+    {"f32",    LexemeClass::FloatType,    ASTNodeSubType::f32},
+    {"f64",    LexemeClass::FloatType,    ASTNodeSubType::f64},
+}};
+// clang-format on
+
+namespace keyword_hash {
+
+// Power of two so the slot is a mask of the hash
+constexpr size_t table_size = 64;
+
+constexpr uint32_t hash(std::string_view word, uint32_t seed) {
+    // FNV-1a, seeded so that a collision free seed can be searched for
+    uint32_t h = 2166136261u ^ seed;
+    for(char c : word) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+constexpr bool is_perfect(uint32_t seed) {
+    std::array<bool, table_size> used{};
+    for(const auto& spec : keyword_specs) {
+        size_t slot = hash(spec.name, seed) & (table_size - 1);
+        if(used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t find_seed() {
+    for(uint32_t seed = 0; seed < 100000; seed++) {
+        if(is_perfect(seed)) {
+            return seed;
+        }
+    }
+    return UINT32_MAX;
+}
+
+inline constexpr uint32_t seed = find_seed();
+static_assert(seed != UINT32_MAX, "No perfect hash seed found for the keyword table, grow table_size");
+
+// Slot -> index into keyword_specs, -1 for an empty slot
+constexpr std::array<int8_t, table_size> build_slots() {
+    std::array<int8_t, table_size> slots{};
+    for(auto& slot : slots) {
+        slot = -1;
+    }
+    for(size_t i = 0; i < keyword_specs.size(); i++) {
+        slots[hash(keyword_specs[i].name, seed) & (table_size - 1)] = static_cast<int8_t>(i);
+    }
+    return slots;
+}
+
+inline constexpr std::array<int8_t, table_size> slots = build_slots();
+
+} // namespace keyword_hash
+
+// O(1) lookup of a reserved word, nullptr when the word is an ordinary identifier
+constexpr const KeywordSpec* find_keyword(std::string_view word) {
+    int8_t index = keyword_hash::slots[keyword_hash::hash(word, keyword_hash::seed) &
+                                       (keyword_hash::table_size - 1)];
+    if(index < 0 || keyword_specs[index].name != word) {
+        return nullptr;
+    }
+    return &keyword_specs[index];
+}
+
+constexpr ASTNodeSubType keyword_sub_type(std::string_view word) {
+    const KeywordSpec* spec = find_keyword(word);
+    return spec == nullptr ? ASTNodeSubType::none : spec->sub_type;
+}
+
+static_assert(find_keyword("i128") != nullptr && find_keyword("i128")->sub_type == ASTNodeSubType::i128);
+static_assert(find_keyword("banana") == nullptr);
@@ -1,171 +1,616 @@
 #include <boost/assert/source_location.hpp>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
-#include <regex>
+#include <mutex>
 #include <string>
 
-#include <stdexcept>
+#include <string_view>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "Diagnostics.hpp"
+#include "Keywords.hpp"
 #include "Lexer.hpp"
+#include "Parallel.hpp"
+#include "Profile.hpp"
+#include "Scan.hpp"
 #include "logging.hpp"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define RAJ_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 SourceCode::SourceCode() {
     LOG_INFO("Initializing Null Source Code")
-    LOG_WARNING(
-        "If creating a null Source Code, ensure you append a newline character to the end of the "
-        "raw document. This is required for the lexer to properly tokenize the document.")
-    this->path         = "/null/path";
-    this->raw_document = "";
+    this->path           = "/null/path";
+    this->raw_document   = "";
+    this->mapping        = nullptr;
+    this->mapping_length = 0;
+    this->file_id        = FileTable::global().add(this->path, this->raw_document);
 }
 
 SourceCode::SourceCode(const std::filesystem::path& filename, std::string content) {
     LOG_INFO("Initializing Source Code: " + std::string(filename))
-    this->path         = filename;
-    this->raw_document = std::move(content);
+    this->path           = filename;
+    this->owned_document = std::make_unique<std::string>(std::move(content));
+    this->raw_document   = *this->owned_document;
+    this->mapping        = nullptr;
+    this->mapping_length = 0;
+    this->file_id        = FileTable::global().add(this->path, this->raw_document);
 }
 
-SourceCode::~SourceCode() = default;
+SourceCode::SourceCode(SourceCode&& other) noexcept {
+    this->path           = std::move(other.path);
+    this->raw_document   = other.raw_document;
+    this->file_id        = other.file_id;
+    this->load_error     = std::move(other.load_error);
+    this->owned_document = std::move(other.owned_document);
+    this->mapping        = other.mapping;
+    this->mapping_length = other.mapping_length;
+    other.raw_document   = "";
+    other.mapping        = nullptr;
+    other.mapping_length = 0;
+}
 
-LexingStateMachine::LexingStateMachine() {
-    this->state = LexerStates::Other;
+SourceCode& SourceCode::operator=(SourceCode&& other) noexcept {
+    if(this != &other) {
+        this->release();
+        this->path           = std::move(other.path);
+        this->raw_document   = other.raw_document;
+        this->file_id        = other.file_id;
+        this->load_error     = std::move(other.load_error);
+        this->owned_document = std::move(other.owned_document);
+        this->mapping        = other.mapping;
+        this->mapping_length = other.mapping_length;
+        other.raw_document   = "";
+        other.mapping        = nullptr;
+        other.mapping_length = 0;
+    }
+    return *this;
 }
 
-LexingStateMachine::~LexingStateMachine() = default;
+SourceCode::~SourceCode() {
+    this->release();
+}
 
-Lexeme::Lexeme() {
-    this->lexeme_type = LexemeClass::Space;
-    this->tokens      = "";
+void SourceCode::release() {
+#ifdef RAJ_HAVE_MMAP
+    if(this->mapping != nullptr) {
+        munmap(this->mapping, this->mapping_length);
+    }
+#endif
+    this->mapping        = nullptr;
+    this->mapping_length = 0;
+    this->owned_document.reset();
+    this->raw_document = "";
+}
+
+bool SourceCode::is_mapped() const {
+    return this->mapping != nullptr;
 }
 
-Lexeme::Lexeme(std::string tokens) {
-    // Interpret the Lexeme class from the tokens given
-    this->tokens = tokens;
-    // Logic for interpreting the type of the lexeme
-    std::regex all_space("\\s+");
-    std::regex is_integer_literal("(\\+|-)?[0-9]+");
-    std::regex is_float_literal("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)");
-    std::regex is_type("(i(1|8|16|32|64))|(u(1|8|16|32|64))|(f(32|64))");
-    std::regex is_math_operator("[+\\-*/%]");
-    std::regex is_comment("#[^\n]*");
-    std::regex is_identifier("[_a-zA-Z][_a-zA-Z0-9]*");
+bool SourceCode::load(const std::filesystem::path& filename) {
+    this->release();
+    this->path = filename;
+    this->load_error.clear();
+    // An empty document under the path, so the failure has a file to be reported in
+    auto fail = [this](std::string reason) {
+        this->release();
+        this->load_error = std::move(reason);
+        this->file_id    = FileTable::global().add(this->path, this->raw_document);
+        return false;
+    };
 
-    if(std::regex_match(tokens, all_space) || tokens.empty()) {
-        this->lexeme_type = LexemeClass::Space;
+    bool            from_stdin = filename == "-";
+    std::error_code status;
+    if(!from_stdin && std::filesystem::is_directory(filename, status)) {
+        return fail("is a directory");
     }
-    else if(std::regex_match(tokens, is_integer_literal)) {
-        this->lexeme_type = LexemeClass::IntegerLiteral;
+#ifdef RAJ_HAVE_MMAP
+    int descriptor = from_stdin ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+    if(descriptor < 0) {
+        return fail(std::strerror(errno));
     }
-    else if(std::regex_match(tokens, is_float_literal)) {
-        this->lexeme_type = LexemeClass::FloatLiteral;
+    struct stat info {};
+    bool        mappable =
+        !from_stdin && fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0;
+    if(mappable && static_cast<uint64_t>(info.st_size) > UINT32_MAX) {
+        // Locations are 32 bit byte offsets
+        close(descriptor);
+        return fail("is larger than 4GiB");
     }
-    else if(std::regex_match(tokens, is_type)) {
-        if(tokens[0] == 'i') {
-            this->lexeme_type = LexemeClass::IntegerType;
-        }
-        else if(tokens[0] == 'u') {
-            this->lexeme_type = LexemeClass::UIntegerType;
+    if(mappable) {
+        void* pages = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if(pages != MAP_FAILED) {
+            madvise(pages, info.st_size, MADV_SEQUENTIAL);
+            this->mapping        = pages;
+            this->mapping_length = info.st_size;
+            this->raw_document   = std::string_view(static_cast<const char*>(pages), info.st_size);
         }
-        else if(tokens[0] == 'f') {
-            this->lexeme_type = LexemeClass::FloatType;
+    }
+    ssize_t count = 0;
+    if(this->mapping == nullptr) {
+        // Pipes, character devices, procfs and empty files cannot be mapped, read them in blocks
+        this->owned_document = std::make_unique<std::string>();
+        char block[1 << 16];
+        while((count = read(descriptor, block, sizeof(block))) > 0) {
+            this->owned_document->append(block, count);
         }
+        this->raw_document = *this->owned_document;
     }
-    else if(tokens == "let") {
-        this->lexeme_type = LexemeClass::Declaration;
+    int read_errno = errno;
+    if(!from_stdin) {
+        close(descriptor);
     }
-    else if(tokens == "if" || tokens == "else" || tokens == "?") {
-        this->lexeme_type = LexemeClass::Conditional;
+    if(count < 0) {
+        return fail(std::strerror(read_errno));
     }
-    else if(tokens == "{") {
-        this->lexeme_type = LexemeClass::CurlL;
+#else
+    std::ifstream file(filename, std::ios::binary);
+    if(!from_stdin && !file) {
+        return fail("could not be opened");
     }
-    else if(tokens == "}") {
-        this->lexeme_type = LexemeClass::CurlR;
+    std::istream& input  = from_stdin ? std::cin : file;
+    this->owned_document = std::make_unique<std::string>();
+    char block[1 << 16];
+    while(input.read(block, sizeof(block)) || input.gcount() > 0) {
+        this->owned_document->append(block, input.gcount());
     }
-    else if(tokens == "[") {
-        this->lexeme_type = LexemeClass::SquareL;
+    if(input.bad()) {
+        return fail("could not be read");
     }
-    else if(tokens == "]") {
-        this->lexeme_type = LexemeClass::SquareR;
+    this->raw_document = *this->owned_document;
+#endif
+    this->file_id = FileTable::global().add(this->path, this->raw_document);
+    return true;
+}
+
+
+namespace {
+
+constexpr size_t num_states       = static_cast<size_t>(LexerStates::Other) + 1;
+constexpr size_t num_char_classes = static_cast<size_t>(CharClass::Other) + 1;
+
+constexpr std::array<CharClass, 256> build_char_classes() {
+    std::array<CharClass, 256> classes{};
+    for(auto& c : classes) {
+        c = CharClass::Other;
     }
-    else if(tokens == "(") {
-        this->lexeme_type = LexemeClass::ParenL;
+    for(unsigned char c = 'a'; c <= 'z'; c++) {
+        classes[c]             = CharClass::Alpha;
+        classes[c - 'a' + 'A'] = CharClass::Alpha;
     }
-    else if(tokens == ")") {
-        this->lexeme_type = LexemeClass::ParenR;
+    for(unsigned char c = '0'; c <= '9'; c++) {
+        classes[c] = CharClass::Digit;
     }
-    else if(tokens == "<") {
-        this->lexeme_type = LexemeClass::ABrackL;
+    for(unsigned char c : std::string_view("+-*/%=!&|^<>()[]{}\'")) {
+        classes[c] = CharClass::Operator;
     }
-    else if(tokens == ">") {
-        this->lexeme_type = LexemeClass::ABrackR;
+    classes['_']  = CharClass::Alpha;
+    classes['.']  = CharClass::Dot;
+    classes['#']  = CharClass::Hash;
+    classes[' ']  = CharClass::Space;
+    classes['\t'] = CharClass::Space;
+    classes['\r'] = CharClass::Space;
+    classes['\n'] = CharClass::Newline;
+    return classes;
+}
+
+constexpr std::array<CharClass, 256> char_classes = build_char_classes();
+
+constexpr std::array<std::array<LexerTransition, num_char_classes>, num_states> build_transitions() {
+    // Default behaviour of every state: the character ends the token and picks the next state
+    // from its own class. Each state then only lists the classes which extend the token.
+    std::array<LexerStates, num_char_classes> start_of = {
+        LexerStates::Space, // Space
+        LexerStates::Space, // Newline
+        LexerStates::Number, // Digit
+        LexerStates::Word, // Alpha
+        LexerStates::Float, // Dot
+        LexerStates::Comment, // Hash
+        LexerStates::Operator, // Operator
+        LexerStates::Other, // Other
+    };
+    std::array<std::array<LexerTransition, num_char_classes>, num_states> table{};
+    for(auto& row : table) {
+        for(size_t c = 0; c < num_char_classes; c++) {
+            row[c] = LexerTransition{start_of[c], true};
+        }
     }
-    else if(tokens == ";") {
-        this->lexeme_type = LexemeClass::SemiColon;
+    auto extend = [&table](LexerStates from, CharClass on, LexerStates to) {
+        table[static_cast<size_t>(from)][static_cast<size_t>(on)] = LexerTransition{to, false};
+    };
+
+    extend(LexerStates::Space, CharClass::Space, LexerStates::Space);
+    extend(LexerStates::Space, CharClass::Newline, LexerStates::Space);
+
+    extend(LexerStates::Word, CharClass::Alpha, LexerStates::Word);
+    extend(LexerStates::Word, CharClass::Digit, LexerStates::Word);
+    // A '.' directly after a word is not the start of a number
+    table[static_cast<size_t>(LexerStates::Word)][static_cast<size_t>(CharClass::Dot)] =
+        LexerTransition{LexerStates::Other, true};
+
+    extend(LexerStates::Number, CharClass::Digit, LexerStates::Number);
+    extend(LexerStates::Number, CharClass::Dot, LexerStates::Float);
+    // Token converted to word, rejected when classified
+    extend(LexerStates::Number, CharClass::Alpha, LexerStates::Word);
+
+    extend(LexerStates::Float, CharClass::Digit, LexerStates::Float);
+    extend(LexerStates::Float, CharClass::Dot, LexerStates::Float);
+    // Token converted to word, rejected when classified e.g. 1.5abc or .abc
+    extend(LexerStates::Float, CharClass::Alpha, LexerStates::Word);
+
+    for(size_t c = 0; c < num_char_classes; c++) {
+        extend(LexerStates::Comment, static_cast<CharClass>(c), LexerStates::Comment);
     }
-    else if(tokens == ":") {
-        this->lexeme_type = LexemeClass::Colon;
+    table[static_cast<size_t>(LexerStates::Comment)][static_cast<size_t>(CharClass::Newline)] =
+        LexerTransition{LexerStates::Space, true};
+
+    extend(LexerStates::Operator, CharClass::Operator, LexerStates::Operator);
+
+    // Every character in the Other state is a token of its own
+    return table;
+}
+
+constexpr std::array<std::array<LexerTransition, num_char_classes>, num_states> transitions =
+    build_transitions();
+
+// The Float state accepts any run of digits and dots, only digits[.digits] with at least one
+// digit is a float e.g. 1.5, .5 or 1. but not . or 1.2.3
+bool valid_float(std::string_view token) {
+    size_t position  = 0;
+    auto   digit_run = [&token, &position]() {
+        size_t start = position;
+        while(position < token.size() && std::isdigit(static_cast<unsigned char>(token[position]))) {
+            position++;
+        }
+        return position - start;
+    };
+    size_t digits = digit_run();
+    if(position < token.size() && token[position] == '.') {
+        position++;
+        digits += digit_run();
     }
-    else if(tokens == ",") {
-        this->lexeme_type = LexemeClass::Comma;
+    return digits > 0 && position == token.size();
+}
+
+LexemeClass classify_word(std::string_view token) {
+    if(std::isdigit(static_cast<unsigned char>(token[0])) || token[0] == '.') {
+        // Numbers running into letters e.g. 12abc or .abc
+        return LexemeClass::Error;
     }
-    else if(tokens == "=") {
-        this->lexeme_type = LexemeClass::Assignment;
+    if(const KeywordSpec* keyword = find_keyword(token)) {
+        return keyword->lexeme_type;
     }
-    else if(tokens == "func") {
-        this->lexeme_type = LexemeClass::Function;
+    return LexemeClass::Identifier;
+}
+
+class OperatorSpec {
+public:
+    std::string_view text;
+    LexemeClass      lexeme_type;
+    bool             recognised; // Reserved by the lexer but not yet given a class of its own
+};
+
+// clang-format off
+constexpr std::array<OperatorSpec, 33> operator_specs = {{
+    {"->", LexemeClass::RightArrow,     true},
+    {"{",  LexemeClass::CurlL,          true},
+    {"}",  LexemeClass::CurlR,          true},
+    {"[",  LexemeClass::SquareL,        true},
+    {"]",  LexemeClass::SquareR,        true},
+    {"(",  LexemeClass::ParenL,         true},
+    {")",  LexemeClass::ParenR,         true},
+    {"<",  LexemeClass::ABrackL,        true},
+    {">",  LexemeClass::ABrackR,        true},
+    {"=",  LexemeClass::Assignment,     true},
+    {"+",  LexemeClass::MathExpression, true},
+    {"-",  LexemeClass::MathExpression, true},
+    {"*",  LexemeClass::MathExpression, true},
+    {"/",  LexemeClass::MathExpression, true},
+    {"%",  LexemeClass::MathExpression, true},
+
+    {"||", LexemeClass::Space,          false},
+    {"==", LexemeClass::Space,          false},
+    {"!=", LexemeClass::Space,          false},
+    {"<=", LexemeClass::Space,          false},
+    {">=", LexemeClass::Space,          false},
+    {"+=", LexemeClass::Space,          false},
+    {"-=", LexemeClass::Space,          false},
+    {"*=", LexemeClass::Space,          false},
+    {"/=", LexemeClass::Space,          false},
+    {"%=", LexemeClass::Space,          false},
+    {"&&", LexemeClass::Space,          false},
+    {"^^", LexemeClass::Space,          false},
+    {"<-", LexemeClass::Space,          false},
+    {"!",  LexemeClass::Space,          false},
+    {"&",  LexemeClass::Space,          false},
+    {"|",  LexemeClass::Space,          false},
+    {"^",  LexemeClass::Space,          false},
+    {"\'", LexemeClass::Space,         false},
+}};
+// clang-format on
+
+class OperatorTrie {
+public:
+    // Nodes are indexed by operator character rather than by byte, -1 is a missing edge
+    static constexpr size_t max_nodes = 64;
+    static constexpr size_t alphabet  = 19;
+
+    std::array<int8_t, 256>                             char_index{};
+    std::array<std::array<int8_t, alphabet>, max_nodes> children{};
+    std::array<int8_t, max_nodes>                       accepts{}; // Index into operator_specs
+    size_t                                              node_count = 1;
+};
+
+constexpr OperatorTrie build_operator_trie() {
+    OperatorTrie trie;
+    for(auto& index : trie.char_index) {
+        index = -1;
     }
-    else if(tokens == "array") {
-        this->lexeme_type = LexemeClass::Array;
+    int8_t next_char = 0;
+    for(unsigned char c : std::string_view("+-*/%=!&|^<>()[]{}\'")) {
+        trie.char_index[c] = next_char++;
     }
-    else if(tokens == "return") {
-        this->lexeme_type = LexemeClass::Return;
+    for(auto& node : trie.children) {
+        for(auto& child : node) {
+            child = -1;
+        }
     }
-    else if(tokens == "->") {
-        this->lexeme_type = LexemeClass::RightArrow;
+    for(auto& accept : trie.accepts) {
+        accept = -1;
     }
-    else if(std::regex_match(tokens, is_math_operator)) {
-        this->lexeme_type = LexemeClass::MathExpression;
+    for(size_t i = 0; i < operator_specs.size(); i++) {
+        size_t node = 0;
+        for(char c : operator_specs[i].text) {
+            int8_t& child = trie.children[node][trie.char_index[static_cast<unsigned char>(c)]];
+            if(child < 0) {
+                child = static_cast<int8_t>(trie.node_count++);
+            }
+            node = child;
+        }
+        trie.accepts[node] = static_cast<int8_t>(i);
     }
-    else if(std::regex_match(tokens, is_comment)) {
-        this->lexeme_type = LexemeClass::Comment;
+    return trie;
+}
+
+constexpr OperatorTrie operator_trie = build_operator_trie();
+
+class OperatorMatch {
+public:
+    size_t length; // 0 when no operator starts the text
+    int    spec;
+};
+
+// Maximal munch: walk the trie as far as the text allows and keep the longest accepting prefix
+constexpr OperatorMatch match_operator(std::string_view text) {
+    OperatorMatch longest{0, -1};
+    size_t        node = 0;
+    for(size_t i = 0; i < text.length(); i++) {
+        int8_t index = operator_trie.char_index[static_cast<unsigned char>(text[i])];
+        if(index < 0 || operator_trie.children[node][index] < 0) {
+            break;
+        }
+        node = operator_trie.children[node][index];
+        if(operator_trie.accepts[node] >= 0) {
+            longest = OperatorMatch{i + 1, operator_trie.accepts[node]};
+        }
     }
-    else if(std::regex_match(tokens, is_identifier)) {
-        this->lexeme_type = LexemeClass::Identifier;
+    return longest;
+}
+
+static_assert(operator_trie.node_count <= OperatorTrie::max_nodes);
+static_assert(match_operator("->x").length == 2);
+static_assert(match_operator("=-").length == 1);
+static_assert(match_operator("*(").length == 1);
+
+LexemeClass classify_operator(std::string_view token) {
+    OperatorMatch match = match_operator(token);
+    if(match.length != token.length() || !operator_specs[match.spec].recognised) {
+        return LexemeClass::Error;
     }
-    else {
-        LOG_ERROR("Lexeme not recognized: " + tokens)
-        LOG_ERROR("Length: " << (tokens.length()))
-        LOG_ERROR("Throwing...")
-        throw std::runtime_error("Lexeme not recognized");
+    return operator_specs[match.spec].lexeme_type;
+}
+
+LexemeClass classify_other(std::string_view token) {
+    if(token.length() == 1) {
+        switch(token[0]) {
+        case '?':
+            return LexemeClass::Conditional;
+        case ';':
+            return LexemeClass::SemiColon;
+        case ':':
+            return LexemeClass::Colon;
+        case ',':
+            return LexemeClass::Comma;
+        default:
+            break;
+        }
     }
+    return LexemeClass::Error;
+}
+
+} // namespace
+
+LexingStateMachine::LexingStateMachine() {
+    this->state       = LexerStates::Space;
+    this->token_start = 0;
+}
+
+LexingStateMachine::~LexingStateMachine() = default;
+
+bool LexingStateMachine::step(char ch) {
+    const CharClass       char_class = char_classes[static_cast<unsigned char>(ch)];
+    const LexerTransition transition =
+        transitions[static_cast<size_t>(this->state)][static_cast<size_t>(char_class)];
+    this->state = transition.next;
+    return transition.emit;
+}
+
+LexemeClass LexingStateMachine::classify(LexerStates final_state, std::string_view token) {
+    switch(final_state) {
+    case LexerStates::Space:
+        return LexemeClass::Space;
+    case LexerStates::Comment:
+        return LexemeClass::Comment;
+    case LexerStates::Number:
+        return LexemeClass::IntegerLiteral;
+    case LexerStates::Float:
+        return valid_float(token) ? LexemeClass::FloatLiteral : LexemeClass::Error;
+    case LexerStates::Word:
+        return classify_word(token);
+    case LexerStates::Operator:
+        return classify_operator(token);
+    case LexerStates::Other:
+        return classify_other(token);
+    }
+    return LexemeClass::Error;
+}
+
+LexemeClass LexingStateMachine::classify(std::string_view token) {
+    if(token.empty()) {
+        return LexemeClass::Space;
+    }
+    LexingStateMachine lsm;
+    lsm.state = transitions[static_cast<size_t>(LexerStates::Space)]
+                           [static_cast<size_t>(char_classes[static_cast<unsigned char>(token[0])])]
+                               .next;
+    for(size_t i = 1; i < token.length(); i++) {
+        if(lsm.step(token[i])) {
+            // The text is more than a single token
+            return LexemeClass::Error;
+        }
+    }
+    return classify(lsm.state, token);
+}
+
+Lexeme::Lexeme() {
+    this->lexeme_type = LexemeClass::Space;
+    this->tokens      = "";
+    this->symbol      = no_symbol;
+}
+
+Lexeme::Lexeme(std::string_view tokens) {
+    // Interpret the Lexeme class from the tokens given, Error if they are not one lexeme
+    this->lexeme_type = LexingStateMachine::classify(tokens);
+    this->tokens      = tokens;
+    this->symbol = this->lexeme_type == LexemeClass::Identifier ? SymbolTable::current().intern(tokens)
+                                                                : no_symbol;
+}
+
+Lexeme::Lexeme(LexemeClass lexeme_type, std::string_view tokens, Symbol symbol) {
+    this->lexeme_type = lexeme_type;
+    this->tokens      = tokens;
+    this->symbol      = symbol;
 }
 
 Lexeme::~Lexeme() = default;
 
+FileTable::FileTable() {
+    // File 0 is where default constructed locations point
+    this->add("NULL_FILE.txt", "");
+}
+
+FileTable& FileTable::global() {
+    static FileTable table;
+    return table;
+}
+
+uint32_t FileTable::add(const std::filesystem::path& path, std::string_view document) {
+    // Index the lines before taking the lock. Newlines are counted first with a vector popcount so
+    // the index is allocated once at its exact size.
+    std::vector<uint32_t> line_starts;
+    line_starts.reserve(count_newlines(document) + 1);
+    line_starts.push_back(0);
+    find_newlines(document, line_starts);
+
+    uint64_t content_hash = SymbolTable::hash(document);
+
+    std::unique_lock lock(this->mutex);
+    auto [existing, inserted] =
+        this->ids.try_emplace(path.string(), static_cast<uint32_t>(this->entries.size()));
+    if(!inserted) {
+        const Entry& latest = this->entries[existing->second];
+        if(latest.content_hash == content_hash && latest.line_starts == line_starts) {
+            return existing->second;
+        }
+        // Changed on disk, locations into the old content keep resolving through the old entry
+        existing->second = static_cast<uint32_t>(this->entries.size());
+    }
+    Entry& entry       = this->entries.emplace_back();
+    entry.path         = path;
+    entry.path_string  = path.string();
+    entry.content_hash = content_hash;
+    entry.line_starts  = std::move(line_starts);
+    return existing->second;
+}
+
+const std::filesystem::path& FileTable::path(uint32_t file_id) const {
+    std::shared_lock lock(this->mutex);
+    return this->entries[file_id].path;
+}
+
+const char* FileTable::c_str(uint32_t file_id) const {
+    std::shared_lock lock(this->mutex);
+    return this->entries[file_id].path_string.c_str();
+}
+
+std::pair<size_t, size_t> FileTable::line_column(uint32_t file_id, uint32_t offset) const {
+    std::shared_lock             lock(this->mutex);
+    const std::vector<uint32_t>& line_starts = this->entries[file_id].line_starts;
+    // First line starting after the offset, the line before it contains the offset
+    auto   next_line = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+    size_t line      = next_line - line_starts.begin();
+    return {line, offset - line_starts[line - 1] + 1};
+}
+
 Location::Location() {
-    this->line   = 0;
-    this->column = 0;
-    this->file   = "NULL_FILE.txt";
+    this->file_id = 0;
+    this->offset  = 0;
+}
+
+Location::Location(uint32_t file_id, uint32_t offset) {
+    this->file_id = file_id;
+    this->offset  = offset;
+}
+
+size_t Location::line() const {
+    return FileTable::global().line_column(this->file_id, this->offset).first;
 }
 
-Location::Location(size_t line, size_t column, const std::string& file) {
-    this->line   = line;
-    this->column = column;
-    this->file   = file;
+size_t Location::column() const {
+    return FileTable::global().line_column(this->file_id, this->offset).second;
 }
 
-std::string Location::to_string() {
-    return this->file.string() + ":" + std::to_string(this->line) + ":" +
-           std::to_string(this->column);
+const std::filesystem::path& Location::file() const {
+    return FileTable::global().path(this->file_id);
 }
-boost::source_location Location::to_boost_source_location() {
-    return boost::source_location(this->file.c_str(), this->line, "undefined", this->column);
+
+std::string Location::to_string() const {
+    auto [line, column] = FileTable::global().line_column(this->file_id, this->offset);
+    return this->file().string() + ":" + std::to_string(line) + ":" + std::to_string(column);
+}
+
+boost::source_location Location::to_boost_source_location() const {
+    auto [line, column] = FileTable::global().line_column(this->file_id, this->offset);
+    return boost::source_location(FileTable::global().c_str(this->file_id),
+                                  static_cast<boost::uint_least32_t>(line),
+                                  "undefined",
+                                  static_cast<boost::uint_least32_t>(column));
 }
 
 std::ostream& operator<<(std::ostream& os, const Location& loc) {
-    os << loc.file.string() << ":" << loc.line << ":" << loc.column << std::endl;
+    os << loc.to_string();
     return os;
 }
 
@@ -173,311 +618,519 @@ Location::~Location() = default;
 
 std::vector<SourceCode> read_raw_file(const std::vector<std::filesystem::path>& file_paths) {
     // Read every single file in the file paths and append them to a vector
-    // mapping of file paths and their raw content
+    // mapping of file paths and their raw content. Regular files are memory mapped, nothing is
+    // copied and no trailing newline is needed, the lexer treats the end of the document as the
+    // end of the last token.
     std::vector<SourceCode> raw_source;
+    raw_source.reserve(file_paths.size());
     for(const auto& filename : file_paths) {
         LOG_INFO("Reading source file: " + filename.string())
         auto extension = filename.extension().string();
-        if(extension != ".raj" && extension != ".jar") {
+        if(filename != "-" && extension != ".raj" && extension != ".jar") {
             LOG_ERROR("File: " << filename << "is not of correct file extension [.raj | .jar]")
             LOG_ERROR("Extension is `" << extension << "`")
         }
 
-        std::ifstream file(filename);
-        if(!file) {
-            LOG_ERROR("Error opening file" << filename)
-        }
-        std::string content((std::istreambuf_iterator<char>(file)),
-                            (std::istreambuf_iterator<char>()));
-        file.close();
-        raw_source.emplace_back(filename, content + "\n");
+        SourceCode& source = raw_source.emplace_back();
+        PROFILE_FILE(profile_file, filename);
+        PROFILE_SCOPE(probe, "read_raw_file");
+        source.load(filename);
+        PROFILE_COUNT(probe, bytes, source.raw_document.length());
     }
     return raw_source;
 }
 
-std::string escape_regex(const std::string& input) {
-    std::string result;
-    for(char c : input) {
-        if(c == '\\' || c == '.' || c == '*' || c == '+' || c == '?' || c == '(' || c == ')' ||
-           c == '[' || c == ']' || c == '{' || c == '}' || c == '|' || c == '^' || c == '$' ||
-           c == '/') {
-            result.push_back('\\'); // Add an escape character before the special character
+TokenBuffer::TokenBuffer() {
+    this->file_id = 0;
+}
+
+TokenBuffer::TokenBuffer(const SourceCode& source) {
+    this->document = source.raw_document;
+    this->file_id  = source.file_id;
+}
+
+TokenBuffer::~TokenBuffer() = default;
+
+size_t TokenBuffer::size() const {
+    return this->kinds.size();
+}
+
+bool TokenBuffer::empty() const {
+    return this->kinds.empty();
+}
+
+LexemeClass TokenBuffer::kind(size_t i) const {
+    return this->kinds[i];
+}
+
+std::string_view TokenBuffer::text(size_t i) const {
+    return this->document.substr(this->offsets[i], this->lengths[i]);
+}
+
+Location TokenBuffer::location(size_t i) const {
+    return Location(this->file_id, this->offsets[i]);
+}
+
+Symbol TokenBuffer::symbol(size_t i) const {
+    return this->symbols[i];
+}
+
+Lexeme TokenBuffer::operator[](size_t i) const {
+    return Lexeme(this->kinds[i], this->text(i), this->symbols[i]);
+}
+
+void TokenBuffer::push_back(LexemeClass kind, uint32_t offset, uint32_t length, Symbol symbol) {
+    this->kinds.push_back(kind);
+    this->offsets.push_back(offset);
+    this->lengths.push_back(length);
+    this->symbols.push_back(symbol);
+}
+
+void TokenBuffer::reserve(size_t n) {
+    this->kinds.reserve(n);
+    this->offsets.reserve(n);
+    this->lengths.reserve(n);
+    this->symbols.reserve(n);
+}
+
+TokenBuffer TokenBuffer::slice(size_t begin, size_t end) const {
+    TokenBuffer sliced;
+    sliced.document = this->document;
+    sliced.file_id  = this->file_id;
+    sliced.kinds.assign(this->kinds.begin() + begin, this->kinds.begin() + end);
+    sliced.offsets.assign(this->offsets.begin() + begin, this->offsets.begin() + end);
+    sliced.lengths.assign(this->lengths.begin() + begin, this->lengths.begin() + end);
+    sliced.symbols.assign(this->symbols.begin() + begin, this->symbols.begin() + end);
+    return sliced;
+}
+
+void generate_operator_lexemes(TokenBuffer& lexemes, uint32_t offset, uint32_t length) {
+    // Split a run of operator characters into individual operators, longest match first. Operators
+    // the lexer reserves but does not know yet become Error tokens.
+    std::string_view run = lexemes.document.substr(offset, length);
+    for(uint32_t position = 0; position < length;) {
+        OperatorMatch match = match_operator(run.substr(position));
+        if(match.length == 0) {
+            // Not the start of any operator, the rest of the run is one Error token
+            lexemes.push_back(LexemeClass::Error, offset + position, length - position);
+            return;
         }
-        result.push_back(c);
+        lexemes.push_back(operator_specs[match.spec].recognised
+                              ? operator_specs[match.spec].lexeme_type
+                              : LexemeClass::Error,
+                          offset + position,
+                          static_cast<uint32_t>(match.length));
+        position += static_cast<uint32_t>(match.length);
+    }
+}
+
+namespace {
+
+void emit_token(TokenBuffer& lexemes,
+                LexerStates  final_state,
+                uint32_t     token_start,
+                uint32_t     token_end,
+                bool         keep_spaces) {
+    if(token_end == token_start || (final_state == LexerStates::Space && !keep_spaces)) {
+        return;
+    }
+    const uint32_t length = token_end - token_start;
+    if(final_state == LexerStates::Operator) {
+        generate_operator_lexemes(lexemes, token_start, length);
+        return;
+    }
+    // Text that is no lexeme is kept as an Error token, whoever consumes the tokens reports it
+    std::string_view token       = lexemes.document.substr(token_start, length);
+    LexemeClass      lexeme_type = LexingStateMachine::classify(final_state, token);
+    // Names are interned as they are lexed, so later phases only compare symbols
+    Symbol symbol =
+        lexeme_type == LexemeClass::Identifier ? SymbolTable::current().intern(token) : no_symbol;
+    lexemes.push_back(lexeme_type, token_start, length, symbol);
+}
+
+uint32_t skip_run(LexerStates state, std::string_view document, uint32_t position, uint32_t end) {
+    // Characters which keep the machine in its state cannot end a token, whole runs of them are
+    // jumped over at once instead of being stepped through. Most runs are a single character, those
+    // are ruled out with one table lookup before calling into the scanning kernels.
+    if(position >= end) {
+        return position;
+    }
+    const LexerTransition transition =
+        transitions[static_cast<size_t>(state)]
+                   [static_cast<size_t>(char_classes[static_cast<unsigned char>(document[position])])];
+    if(transition.emit || transition.next != state) {
+        return position;
+    }
+    const char* cursor = document.data() + position;
+    const char* limit  = document.data() + end;
+    switch(state) {
+    case LexerStates::Space:
+        cursor = skip_spaces(cursor, limit);
+        break;
+    case LexerStates::Word:
+        cursor = skip_word(cursor, limit);
+        break;
+    case LexerStates::Number:
+    case LexerStates::Float:
+        cursor = skip_digits(cursor, limit);
+        break;
+    case LexerStates::Comment: {
+        // The newline ends the comment
+        auto newline = static_cast<const char*>(std::memchr(cursor, '\n', limit - cursor));
+        cursor       = newline == nullptr ? limit : newline;
+        break;
     }
-    return result;
+    default:
+        break;
+    }
+    return static_cast<uint32_t>(cursor - document.data());
 }
 
-std::string generate_regex_from_strings(const std::vector<std::string>& strings) {
-    std::string regexStr;
-    for(const auto& str : strings) {
-        if(!regexStr.empty()) {
-            regexStr += "|"; // Use the pipe symbol for alternation
+void lex_range(TokenBuffer&        lexemes,
+               LexingStateMachine& lsm,
+               uint32_t            begin,
+               uint32_t            end,
+               bool                keep_spaces) {
+    // Lex [begin, end) continuing from the machine's state, the token still open at the end is
+    // left in the machine for the caller to finish
+    std::string_view document = lexemes.document;
+    for(uint32_t x = begin; x < end;) {
+        const char        ch          = document[x];
+        const LexerStates final_state = lsm.state;
+        // Per character transition, the token is classified only once it ends
+        if(lsm.step(ch)) {
+            emit_token(lexemes, final_state, lsm.token_start, x, keep_spaces);
+            lsm.token_start = x;
         }
-        regexStr += escape_regex(str);
+        x = skip_run(lsm.state, document, x + 1, end);
     }
-    return regexStr;
 }
 
-std::vector<std::tuple<Lexeme, Location>> generate_operator_lexemes(std::string     s,
-                                                                    const Location& loc) {
-    std::vector<std::string> ops = {
-        // Order matters here preference is given to the first string
-        "||", "==", "!=", "<=", ">=", "+=", "-=", "*=", "/=", "%=", "&&",
-        "^^", "->", "<-", "+",  "-",  "*",  "/",  "%",  "=",  "!",  "&",
-        "|",  "^",  "<",  ">",  "(",  ")",  "[",  "]",  "{",  "}",  "\'",
-    };
+void append_tokens(TokenBuffer& lexemes, const TokenBuffer& chunk) {
+    size_t first = 0;
+    // Whitespace split by a chunk boundary is one token when lexed serially
+    if(!lexemes.empty() && !chunk.empty() && lexemes.kinds.back() == LexemeClass::Space &&
+       chunk.kinds[0] == LexemeClass::Space &&
+       lexemes.offsets.back() + lexemes.lengths.back() == chunk.offsets[0]) {
+        lexemes.lengths.back() += chunk.lengths[0];
+        first = 1;
+    }
+    lexemes.kinds.insert(lexemes.kinds.end(), chunk.kinds.begin() + first, chunk.kinds.end());
+    lexemes.offsets.insert(
+        lexemes.offsets.end(), chunk.offsets.begin() + first, chunk.offsets.end());
+    lexemes.lengths.insert(
+        lexemes.lengths.end(), chunk.lengths.begin() + first, chunk.lengths.end());
+    lexemes.symbols.insert(
+        lexemes.symbols.end(), chunk.symbols.begin() + first, chunk.symbols.end());
+}
+
+} // namespace
 
-    std::regex                                 words_regex(generate_regex_from_strings(ops));
-    std::regex_iterator<std::string::iterator> iter(s.begin(), s.end(), words_regex);
-    std::regex_iterator<std::string::iterator> end;
-    std::vector<std::string>                   matches;
-    std::vector<Location>                      locations;
-    uint                                       matched_length = 0;
-    while(iter != end) {
-        matches.push_back(iter->str()); // Store the matched substring in the vector
-        matched_length += iter->str().length();
-        locations.emplace_back(loc.line, loc.column + matched_length, loc.file);
-        ++iter;
-    }
-    if(matched_length != s.length()) {
-        LOG_ERROR("Error generating operator lexemes")
-        LOG_ERROR("Matched length: " << matched_length)
-        LOG_ERROR("Actual length: " << s.length() << "String: " << s)
-        LOG_ERROR("Throwing...")
-        throw std::runtime_error("Error generating operator lexemes");
-    }
-    std::vector<std::tuple<Lexeme, Location>> lexemes;
-    for(size_t i = 0; i < matches.size(); i++) {
-        std::string match = matches[i];
-        Location    l     = locations[i];
-        Lexeme      lexeme(match);
-        lexemes.emplace_back(lexeme, l);
+TokenBuffer lex_file(const SourceCode& file, bool keep_spaces) {
+    PROFILE_SCOPE(probe, "lex_file");
+    TokenBuffer        lexemes(file);
+    LexingStateMachine lsm = LexingStateMachine();
+    // Rough guess of one token per 4 characters, saves most of the regrowth
+    lexemes.reserve(file.raw_document.length() / 4);
+
+    const auto length = static_cast<uint32_t>(file.raw_document.length());
+    lex_range(lexemes, lsm, 0, length, keep_spaces);
+    // End of input is the sentinel which ends the last token, no trailing newline is required
+    emit_token(lexemes, lsm.state, lsm.token_start, length, keep_spaces);
+    PROFILE_COUNT(probe, bytes, length);
+    PROFILE_COUNT(probe, tokens, lexemes.size());
+    return lexemes;
+}
+
+TokenBuffer lex_file_parallel(const SourceCode& file,
+                              size_t            jobs,
+                              bool              keep_spaces,
+                              size_t            min_chunk_size) {
+    std::string_view document = file.raw_document;
+    size_t chunks = std::min(jobs, document.length() / std::max<size_t>(min_chunk_size, 1));
+    if(chunks <= 1) {
+        return lex_file(file, keep_spaces);
     }
+    PROFILE_SCOPE(probe, "lex_file");
+
+    // Chunks end just after a newline. A newline ends every kind of token (comments included) and
+    // leaves the machine in LexerStates::Space, so every chunk is lexed from the state it really
+    // starts in and nothing is ever lexed twice.
+    std::vector<uint32_t> boundaries = {0};
+    for(size_t c = 1; c < chunks; c++) {
+        size_t nominal = std::max<size_t>(c * document.length() / chunks, boundaries.back());
+        auto   newline = static_cast<const char*>(
+            std::memchr(document.data() + nominal, '\n', document.length() - nominal));
+        if(newline == nullptr) {
+            break;
+        }
+        boundaries.push_back(static_cast<uint32_t>(newline - document.data() + 1));
+    }
+    if(boundaries.back() < document.length()) {
+        boundaries.push_back(static_cast<uint32_t>(document.length()));
+    }
+    chunks = boundaries.size() - 1;
+
+    std::vector<TokenBuffer>        pieces(chunks, TokenBuffer(file));
+    std::vector<LexingStateMachine> open_tokens(chunks);
+    // Names are interned into the table of the compilation that asked, whichever thread lexes
+    SymbolTable& symbols = SymbolTable::current();
+    parallel_for(chunks, jobs, [&](size_t c) {
+        SymbolTable* outer = SymbolTable::use(&symbols);
+        pieces[c].reserve((boundaries[c + 1] - boundaries[c]) / 4);
+        open_tokens[c].token_start = boundaries[c];
+        lex_range(pieces[c], open_tokens[c], boundaries[c], boundaries[c + 1], keep_spaces);
+        SymbolTable::use(outer);
+    });
+
+    // Stitch. The token open at the end of a chunk is whitespace up to the chunk boundary, it is
+    // finished there unless the next chunk is whitespace all through and continues it.
+    TokenBuffer lexemes(file);
+    lexemes.reserve(document.length() / 4);
+    LexingStateMachine carry = open_tokens[0];
+    append_tokens(lexemes, pieces[0]);
+    for(size_t c = 1; c < chunks; c++) {
+        if(pieces[c].empty() && open_tokens[c].state == LexerStates::Space) {
+            open_tokens[c].token_start = carry.token_start;
+        }
+        else {
+            emit_token(lexemes, carry.state, carry.token_start, boundaries[c], keep_spaces);
+            append_tokens(lexemes, pieces[c]);
+        }
+        carry = open_tokens[c];
+    }
+    const auto length = static_cast<uint32_t>(document.length());
+    emit_token(lexemes, carry.state, carry.token_start, length, keep_spaces);
+    PROFILE_COUNT(probe, bytes, length);
+    PROFILE_COUNT(probe, tokens, lexemes.size());
     return lexemes;
 }
 
-bool is_operator(int ch) {
-    std::vector<char> single_ops = {
-        '+', '-', '*', '/', '%', '=', '!', '&', '|',  '^',
-        '<', '>', '(', ')', '[', ']', '{', '}', '\'',
-    };
-    return (std::find(single_ops.begin(), single_ops.end(), ch) != single_ops.end());
-}
-
-std::vector<std::tuple<Lexeme, Location>> lex_file(SourceCode file) {
-    std::vector<std::tuple<Lexeme, Location>> lexemes;
-    LexingStateMachine                        lsm = LexingStateMachine();
-    std::string                               accumulator;
-
-    size_t line_number   = 1;
-    size_t column_number = 1;
-    for(size_t x = 0; x < file.raw_document.length(); x++) {
-        const char ch = file.raw_document[x];
-        column_number++;
-        if(ch == '\n') {
-            line_number++;
-            column_number = 1;
+Lexer::Lexer(const SourceCode& source, bool keep_spaces) : pending(source) {
+    this->pending_index = 0;
+    this->position      = 0;
+    this->keep_spaces   = keep_spaces;
+    this->finished      = false;
+}
+
+Lexer::Lexer(std::string_view document, uint32_t file_id, bool keep_spaces) {
+    this->pending.document = document;
+    this->pending.file_id  = file_id;
+    this->pending_index    = 0;
+    this->position         = 0;
+    this->keep_spaces      = keep_spaces;
+    this->finished         = false;
+}
+
+Lexer::~Lexer() = default;
+
+std::string_view Lexer::document() const {
+    return this->pending.document;
+}
+
+uint32_t Lexer::file_id() const {
+    return this->pending.file_id;
+}
+
+void Lexer::fill() {
+    // Run the machine until at least one token is complete, the pending buffer is reused so the
+    // memory held never grows with the size of the document
+    this->pending.kinds.clear();
+    this->pending.offsets.clear();
+    this->pending.lengths.clear();
+    this->pending.symbols.clear();
+    this->pending_index = 0;
+
+    std::string_view document = this->pending.document;
+    const auto       length   = static_cast<uint32_t>(document.length());
+    while(this->pending.empty() && this->position < length) {
+        const LexerStates final_state = this->lsm.state;
+        if(this->lsm.step(document[this->position])) {
+            emit_token(this->pending,
+                       final_state,
+                       this->lsm.token_start,
+                       this->position,
+                       this->keep_spaces);
+            this->lsm.token_start = this->position;
+        }
+        this->position = skip_run(this->lsm.state, document, this->position + 1, length);
+    }
+    if(this->pending.empty()) {
+        // End of input ends the last token
+        emit_token(this->pending, this->lsm.state, this->lsm.token_start, length, this->keep_spaces);
+        this->finished = true;
+    }
+}
+
+void Lexer::seek(uint32_t offset) {
+    // A token starts in the Space state, exactly as at the start of the document
+    this->pending.kinds.clear();
+    this->pending.offsets.clear();
+    this->pending.lengths.clear();
+    this->pending.symbols.clear();
+    this->pending_index   = 0;
+    this->lsm             = LexingStateMachine();
+    this->lsm.token_start = offset;
+    this->position        = offset;
+    this->finished        = false;
+}
+
+bool Lexer::next(LexemeClass& kind, uint32_t& offset, uint32_t& length, Symbol& symbol) {
+    if(this->pending_index == this->pending.size()) {
+        if(this->finished) {
+            return false;
+        }
+        this->fill();
+        if(this->pending.empty()) {
+            return false;
+        }
+    }
+    kind   = this->pending.kinds[this->pending_index];
+    offset = this->pending.offsets[this->pending_index];
+    length = this->pending.lengths[this->pending_index];
+    symbol = this->pending.symbols[this->pending_index];
+    this->pending_index++;
+    return true;
+}
+
+// The ring index is masked rather than taken modulo
+static_assert((TokenStream::lookahead & (TokenStream::lookahead - 1)) == 0);
+
+TokenStream::TokenStream(Lexer& lexer, bool keep_comments) {
+    this->lexer         = &lexer;
+    this->buffer        = nullptr;
+    this->buffer_index  = 0;
+    this->document      = lexer.document();
+    this->file_id       = lexer.file_id();
+    this->keep_comments = keep_comments;
+    this->head          = 0;
+    this->count         = 0;
+    this->pulled_count  = 0;
+}
+
+TokenStream::TokenStream(const TokenBuffer& buffer, bool keep_comments) {
+    this->lexer         = nullptr;
+    this->buffer        = &buffer;
+    this->buffer_index  = 0;
+    this->document      = buffer.document;
+    this->file_id       = buffer.file_id;
+    this->keep_comments = keep_comments;
+    this->head          = 0;
+    this->count         = 0;
+    this->pulled_count  = 0;
+}
+
+TokenStream::~TokenStream() = default;
+
+void TokenStream::fill(size_t k) {
+    // The parser never looks further ahead than the ring holds
+    assert(k < lookahead && "Token stream lookahead exceeded");
+    while(this->count <= k) {
+        size_t slot = (this->head + this->count) & (lookahead - 1);
+        bool   pulled;
+        if(this->lexer != nullptr) {
+            pulled = this->lexer->next(
+                this->kinds[slot], this->offsets[slot], this->lengths[slot], this->symbols[slot]);
         }
-        Location location(line_number, column_number, file.path);
-
-        // Per character do Lexing
-        try {
-            switch(lsm.state) {
-            case LexerStates::Space:
-                if(ch == ' ' || ch == '\n' || ch == '\t') {
-                    lsm.state = LexerStates::Space;
-                    accumulator += ch;
-                }
-                else if(std::isdigit(ch) || ch == '.') {
-                    lsm.state = LexerStates::Number;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(ch == '#') {
-                    lsm.state = LexerStates::Comment;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(std::isalpha(ch) || ch == '_') {
-                    lsm.state = LexerStates::Word;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(is_operator(ch)) {
-                    lsm.state = LexerStates::Operator;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else {
-                    lsm.state = LexerStates::Other;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                break;
-
-            case LexerStates::Word:
-                if(ch == ' ' || ch == '\n' || ch == '\t') {
-                    lsm.state = LexerStates::Space;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(std::isalnum(ch) || ch == '_') {
-                    lsm.state = LexerStates::Word;
-                    accumulator += ch;
-                }
-                else if(ch == '#') {
-                    lsm.state = LexerStates::Comment;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(is_operator(ch)) {
-                    lsm.state = LexerStates::Operator;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else {
-                    lsm.state = LexerStates::Other;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                break;
-
-            case LexerStates::Number:
-                if(std::isdigit(ch) || ch == '.' || ch == 'e' || ch == 'E') {
-                    // Special case for floating point numbers
-                    lsm.state = LexerStates::Number;
-                    accumulator += ch;
-                }
-                else if(ch == ' ' || ch == '\n' || ch == '\t') {
-                    lsm.state = LexerStates::Space;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(ch == '#') {
-                    lsm.state = LexerStates::Comment;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(std::isalpha(ch) || ch == '_') {
-                    // token converted to word
-                    lsm.state = LexerStates::Word;
-                    accumulator += ch;
-                }
-                else if(is_operator(ch)) {
-                    lsm.state = LexerStates::Operator;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else {
-                    lsm.state = LexerStates::Other;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                break;
-
-            case LexerStates::Comment:
-                if(ch == '\n') {
-                    lsm.state = LexerStates::Space;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else {
-                    lsm.state = LexerStates::Comment;
-                    accumulator += ch;
-                }
-                break;
-
-            case LexerStates::Operator:
-                if(is_operator(ch)) {
-                    lsm.state = LexerStates::Operator;
-                    accumulator += ch;
-                }
-                else if(ch == ' ' || ch == '\n' || ch == '\t') {
-                    lsm.state       = LexerStates::Space;
-                    auto op_lexemes = generate_operator_lexemes(accumulator, location);
-                    lexemes.insert(lexemes.end(), op_lexemes.begin(), op_lexemes.end());
-                    accumulator = ch;
-                }
-                else if(std::isdigit(ch) || ch == '.') {
-                    lsm.state       = LexerStates::Number;
-                    auto op_lexemes = generate_operator_lexemes(accumulator, location);
-                    lexemes.insert(lexemes.end(), op_lexemes.begin(), op_lexemes.end());
-                    accumulator = ch;
-                }
-                else if(std::isalpha(ch) || ch == '_') {
-                    lsm.state       = LexerStates::Word;
-                    auto op_lexemes = generate_operator_lexemes(accumulator, location);
-                    lexemes.insert(lexemes.end(), op_lexemes.begin(), op_lexemes.end());
-                    accumulator = ch;
-                }
-                else if(ch == '#') {
-                    lsm.state       = LexerStates::Comment;
-                    auto op_lexemes = generate_operator_lexemes(accumulator, location);
-                    lexemes.insert(lexemes.end(), op_lexemes.begin(), op_lexemes.end());
-                    accumulator = ch;
-                }
-                else {
-                    lsm.state       = LexerStates::Other;
-                    auto op_lexemes = generate_operator_lexemes(accumulator, location);
-                    lexemes.insert(lexemes.end(), op_lexemes.begin(), op_lexemes.end());
-                    accumulator = ch;
-                }
-                break;
-            case LexerStates::Other: // Default state or undefined state
-                if(ch == ' ' || ch == '\n' || ch == '\t') {
-                    lsm.state = LexerStates::Space;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(ch == '#') {
-                    lsm.state = LexerStates::Comment;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(std::isdigit(ch) || ch == '.') {
-                    lsm.state = LexerStates::Number;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(std::isalpha(ch) || ch == '_') {
-                    lsm.state = LexerStates::Word;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else if(is_operator(ch)) {
-                    lsm.state = LexerStates::Operator;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                else {
-                    lsm.state = LexerStates::Other;
-                    lexemes.emplace_back(Lexeme(accumulator), location);
-                    accumulator = ch;
-                }
-                break;
+        else {
+            pulled = this->buffer_index < this->buffer->size();
+            if(pulled) {
+                this->kinds[slot]   = this->buffer->kinds[this->buffer_index];
+                this->offsets[slot] = this->buffer->offsets[this->buffer_index];
+                this->lengths[slot] = this->buffer->lengths[this->buffer_index];
+                this->symbols[slot] = this->buffer->symbols[this->buffer_index];
+                this->buffer_index++;
             }
         }
-        catch(const std::runtime_error& err) {
-            LOG_ERROR(err.what())
-            LOG_ERROR("Unrecognized lexeme: " << accumulator)
-            LOG_ERROR("Failure on line " << file.path << ":" << line_number)
-            accumulator = ch;
+        this->pulled_count += pulled ? 1 : 0;
+        if(!pulled) {
+            // Past the end every token is EndOfInput, located at the end of the document
+            this->kinds[slot]   = LexemeClass::EndOfInput;
+            this->offsets[slot] = static_cast<uint32_t>(this->document.length());
+            this->lengths[slot] = 0;
+            this->symbols[slot] = no_symbol;
         }
+        else if(this->kinds[slot] == LexemeClass::Comment && !this->keep_comments) {
+            // The slot is reused by the next token
+            continue;
+        }
+        else if(this->kinds[slot] == LexemeClass::Error) {
+            // Dropped once reported, the parser carries on with the tokens around it
+            report_error(Location(this->file_id, this->offsets[slot]),
+                         "Unrecognized lexeme ",
+                         this->document.substr(this->offsets[slot], this->lengths[slot]));
+            continue;
+        }
+        this->count++;
     }
-    return lexemes;
 }
 
-std::vector<std::tuple<Lexeme, Location>>
-filter_spaces(std::vector<std::tuple<Lexeme, Location>> lexemes) {
-    // Filter out spaces using the modern C++ STL
-    // https://stackoverflow.com/a/21204788/8679866
-    std::vector<std::tuple<Lexeme, Location>> filtered;
-    std::copy_if(lexemes.begin(),
-                 lexemes.end(),
-                 std::back_inserter(filtered),
-                 [](std::tuple<Lexeme, Location> i) {
-                     return std::get<0>(i).lexeme_type != LexemeClass::Space;
-                 });
-    return filtered;
-}
\ No newline at end of file
+Lexeme TokenStream::peek(size_t k) {
+    this->fill(k);
+    size_t slot = (this->head + k) & (lookahead - 1);
+    return Lexeme(this->kinds[slot],
+                  this->document.substr(this->offsets[slot], this->lengths[slot]),
+                  this->symbols[slot]);
+}
+
+LexemeClass TokenStream::peek_kind(size_t k) {
+    this->fill(k);
+    return this->kinds[(this->head + k) & (lookahead - 1)];
+}
+
+Location TokenStream::location(size_t k) {
+    this->fill(k);
+    return Location(this->file_id, this->offsets[(this->head + k) & (lookahead - 1)]);
+}
+
+Lexeme TokenStream::next() {
+    Lexeme lexeme = this->peek(0);
+    this->head    = (this->head + 1) & (lookahead - 1);
+    this->count--;
+    return lexeme;
+}
+
+bool TokenStream::at_end() {
+    return this->peek_kind(0) == LexemeClass::EndOfInput;
+}
+
+void TokenStream::skip_to(uint32_t offset) {
+    this->head  = 0;
+    this->count = 0;
+    if(this->lexer != nullptr) {
+        this->lexer->seek(offset);
+        return;
+    }
+    // Tokens already in the ring may lie past offset, so the whole buffer is searched
+    const std::vector<uint32_t>& offsets = this->buffer->offsets;
+    this->buffer_index = std::lower_bound(offsets.begin(), offsets.end(), offset) - offsets.begin();
+}
+
+std::string_view TokenStream::source() const {
+    return this->document;
+}
+
+size_t TokenStream::pulled() const {
+    return this->pulled_count;
+}
+
+void filter_spaces(TokenBuffer& lexemes) {
+    PROFILE_SCOPE(probe, "filter_spaces");
+    PROFILE_COUNT(probe, tokens, lexemes.size());
+    // Compact every parallel array in place, keeping only the non space tokens
+    size_t kept = 0;
+    for(size_t i = 0; i < lexemes.size(); i++) {
+        if(lexemes.kinds[i] == LexemeClass::Space) {
+            continue;
+        }
+        lexemes.kinds[kept]   = lexemes.kinds[i];
+        lexemes.offsets[kept] = lexemes.offsets[i];
+        lexemes.lengths[kept] = lexemes.lengths[i];
+        lexemes.symbols[kept] = lexemes.symbols[i];
+        kept++;
+    }
+    lexemes.kinds.resize(kept);
+    lexemes.offsets.resize(kept);
+    lexemes.lengths.resize(kept);
+    lexemes.symbols.resize(kept);
+}
@@ -4,36 +4,79 @@
 #include <boost/assert/source_location.hpp>
 #include <filesystem>
 #include <fstream>
+#include <memory>
 
 // String Manipulation
-#include <regex>
 #include <string>
+#include <vector>
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 
 // Logging
 #include "logging.hpp"
 
+#include "Symbols.hpp"
+
 class SourceCode {
 public:
     /* Raw data for the source code, contains Path and Source */
     std::filesystem::path path;
-    std::string           raw_document;
+    // View of either the memory mapped file or the owned copy, stays valid when the SourceCode moves
+    std::string_view raw_document;
+    uint32_t         file_id; // Entry in the FileTable, used by every Location into this source
+    // Why the last load failed, empty when it worked. The source is then empty but its path is
+    // still interned, so the failure can be reported at a Location in the file.
+    std::string load_error;
 
     SourceCode();
     SourceCode(const std::filesystem::path& filename, std::string content);
+    SourceCode(SourceCode&& other) noexcept;
+    SourceCode& operator=(SourceCode&& other) noexcept;
+    SourceCode(const SourceCode&)            = delete;
+    SourceCode& operator=(const SourceCode&) = delete;
     ~SourceCode();
+
+    // Map a regular file straight into memory, falls back to buffered reads for pipes, character
+    // devices and stdin ("-"). Returns false and sets load_error if the file could not be read.
+    bool load(const std::filesystem::path& filename);
+    [[nodiscard]] bool is_mapped() const;
+
+private:
+    std::unique_ptr<std::string> owned_document; // On the heap so moves keep raw_document valid
+    void*                        mapping;
+    size_t                       mapping_length;
+
+    void release();
 };
 
 enum class LexerStates {
     Space,
     Word,
     Number,
+    Float,
     Comment,
     Operator,
     Other,
 };
 
+enum class CharClass : uint8_t {
+    Space, // ' ', \t, \r
+    Newline, // \n
+    Digit, // 0-9
+    Alpha, // a-z, A-Z, _
+    Dot, // .
+    Hash, // #
+    Operator, // +, -, *, /, %, =, !, &, |, ^, <, >, (, ), [, ], {, }, '
+    Other, // everything else
+};
+
 enum class LexemeClass {
     Space, // e.g. \t
 
@@ -44,6 +87,7 @@ enum class LexemeClass {
     Assignment, // =
     Conditional, // if, else, ternary: ?
     Return, // return
+    Cast, // as
 
     IntegerLiteral, // e.g. 153
     FloatLiteral, // e.g. 15.3
@@ -70,43 +114,214 @@ enum class LexemeClass {
     ParenR, // )
     ABrackL, // <
     ABrackR, // >
+
+    EndOfInput, // Returned by a TokenStream once the source is exhausted
+    Error, // Text that is no lexeme, reported and dropped by the TokenStream
+};
+
+struct LexerTransition {
+    LexerStates next;
+    bool        emit; // The character ends the current token and begins a new one
 };
 
 class LexingStateMachine {
 public:
     LexerStates state;
+    uint32_t    token_start; // Offset where the token that is still being accumulated began
 
     LexingStateMachine();
     ~LexingStateMachine();
+
+    // Advance on a single character, returns true when the token accumulated so far is complete
+    bool step(char ch);
+
+    // Decide the class of a finished token from the state the machine was in when it ended, Error
+    // if it is no lexeme
+    static LexemeClass classify(LexerStates final_state, std::string_view token);
+    // Run the machine over a whole token and classify it, Error for text that is not one lexeme
+    static LexemeClass classify(std::string_view token);
 };
 
 class Lexeme {
 public:
-    // Holds each lexeme which is an enum of type of lexeme and corresponding data
-    LexemeClass lexeme_type;
-    std::string tokens;
+    // Holds each lexeme which is an enum of type of lexeme and a view of its text in the source
+    LexemeClass      lexeme_type;
+    std::string_view tokens;
+    Symbol           symbol; // Interned name of an Identifier, no_symbol for everything else
     Lexeme();
-    explicit Lexeme(std::string tokens);
+    explicit Lexeme(std::string_view tokens);
+    Lexeme(LexemeClass lexeme_type, std::string_view tokens, Symbol symbol = no_symbol);
     ~Lexeme();
     bool operator==(const Lexeme& rhs) const {
         return (rhs.lexeme_type == this->lexeme_type) && (rhs.tokens == this->tokens);
     }
 };
 
+class FileTable {
+public:
+    // Process wide table of interned source files. Each file keeps the start offset of every line
+    // so that a Location only has to store a byte offset, line and column are resolved on demand.
+    // Entries are never removed, any Location stays resolvable for the life of the process.
+    static FileTable& global();
+
+    // Intern the path and index the lines of its document. Adding the same path and content again
+    // returns the same id, a path whose content changed gets a new id and the old one stays valid.
+    uint32_t add(const std::filesystem::path& path, std::string_view document);
+
+    [[nodiscard]] const std::filesystem::path& path(uint32_t file_id) const;
+    [[nodiscard]] const char*                  c_str(uint32_t file_id) const;
+    // 1 based line and column of a byte offset
+    [[nodiscard]] std::pair<size_t, size_t> line_column(uint32_t file_id, uint32_t offset) const;
+
+private:
+    class Entry {
+    public:
+        std::filesystem::path path;
+        std::string           path_string;
+        uint64_t              content_hash = 0;
+        std::vector<uint32_t> line_starts;
+    };
+
+    FileTable();
+
+    mutable std::shared_mutex                 mutex;
+    std::deque<Entry>                         entries;
+    std::unordered_map<std::string, uint32_t> ids; // Latest entry of each path
+};
+
 class Location {
 public:
-    size_t                line;
-    size_t                column;
-    std::filesystem::path file;
+    // Compact position in a source, the interned file and a byte offset into it
+    uint32_t file_id;
+    uint32_t offset;
     Location();
-    Location(size_t line, size_t column, const std::string& file);
-    std::string            to_string();
-    boost::source_location to_boost_source_location();
+    Location(uint32_t file_id, uint32_t offset);
+    [[nodiscard]] size_t                       line() const;
+    [[nodiscard]] size_t                       column() const;
+    [[nodiscard]] const std::filesystem::path& file() const;
+    [[nodiscard]] std::string                  to_string() const;
+    [[nodiscard]] boost::source_location       to_boost_source_location() const;
     ~Location();
     friend std::ostream& operator<<(std::ostream& os, const Location& loc);
 };
 
-std::vector<std::tuple<Lexeme, Location>> lex_file(SourceCode file);
+class TokenBuffer {
+public:
+    // Tokens of one source stored as parallel arrays. Token text is never copied, it is a span
+    // into SourceCode::raw_document, so the source must outlive the buffer.
+    std::string_view         document;
+    uint32_t                 file_id;
+    std::vector<LexemeClass> kinds;
+    std::vector<uint32_t>    offsets;
+    std::vector<uint32_t>    lengths;
+    std::vector<Symbol>      symbols; // Interned while lexing, no_symbol unless an Identifier
+
+    TokenBuffer();
+    explicit TokenBuffer(const SourceCode& source);
+    ~TokenBuffer();
+
+    [[nodiscard]] size_t           size() const;
+    [[nodiscard]] bool             empty() const;
+    [[nodiscard]] LexemeClass      kind(size_t i) const;
+    [[nodiscard]] std::string_view text(size_t i) const;
+    [[nodiscard]] Location         location(size_t i) const;
+    [[nodiscard]] Symbol           symbol(size_t i) const;
+    [[nodiscard]] Lexeme           operator[](size_t i) const;
+
+    void push_back(LexemeClass kind, uint32_t offset, uint32_t length, Symbol symbol = no_symbol);
+    void reserve(size_t n);
+    // Copy of the tokens in [begin, end)
+    [[nodiscard]] TokenBuffer slice(size_t begin, size_t end) const;
+};
+
+class Lexer {
+public:
+    // Incremental lexer, hands out one token per call so the tokens of a source never have to be
+    // materialised at once. Produces exactly the tokens of lex_file in the same order.
+    explicit Lexer(const SourceCode& source, bool keep_spaces = false);
+    Lexer(std::string_view document, uint32_t file_id, bool keep_spaces = false);
+    ~Lexer();
+
+    // Next token of the source, false once it is exhausted
+    bool next(LexemeClass& kind, uint32_t& offset, uint32_t& length, Symbol& symbol);
+    // Continue lexing at offset, which has to be the start of a token
+    void seek(uint32_t offset);
+
+    [[nodiscard]] std::string_view document() const;
+    [[nodiscard]] uint32_t         file_id() const;
+
+private:
+    TokenBuffer        pending; // Tokens of the last completed run, an operator run can be several
+    size_t             pending_index;
+    LexingStateMachine lsm;
+    uint32_t           position;
+    bool               keep_spaces;
+    bool               finished;
+
+    void fill();
+};
+
+class TokenStream {
+public:
+    // Pull based view of the tokens the parser consumes with a small, fixed amount of lookahead.
+    // Tokens come either straight from a Lexer or from an already lexed TokenBuffer.
+    static constexpr size_t lookahead = 8;
+
+    // Comments are passed through unless keep_comments is false, the parser has no use for them.
+    // Error tokens are reported when pulled and never handed out.
+    explicit TokenStream(Lexer& lexer, bool keep_comments = true);
+    explicit TokenStream(const TokenBuffer& buffer, bool keep_comments = true);
+    ~TokenStream();
+
+    // Token k ahead of the cursor (k < lookahead), EndOfInput past the end of the source
+    [[nodiscard]] Lexeme      peek(size_t k = 0);
+    [[nodiscard]] LexemeClass peek_kind(size_t k = 0);
+    [[nodiscard]] Location    location(size_t k = 0);
+    // Consume and return the token at the cursor
+    Lexeme next();
+    bool   at_end();
+    // Drop the tokens ahead of the cursor and continue with the first one at or after offset,
+    // which has to be the start of a token
+    void   skip_to(uint32_t offset);
+
+    [[nodiscard]] std::string_view source() const;
+    // Tokens taken from the lexer or buffer so far, comments and errors included
+    [[nodiscard]] size_t           pulled() const;
+
+private:
+    Lexer*             lexer;
+    const TokenBuffer* buffer;
+    size_t             buffer_index;
+    std::string_view   document;
+    uint32_t           file_id;
+    bool               keep_comments;
+
+    // Ring of the tokens already pulled from the source but not consumed
+    std::array<LexemeClass, lookahead> kinds;
+    std::array<uint32_t, lookahead>    offsets;
+    std::array<uint32_t, lookahead>    lengths;
+    std::array<Symbol, lookahead>      symbols;
+    size_t                             head;
+    size_t                             count;
+    size_t                             pulled_count;
+
+    void fill(size_t k);
+};
+
+// Whitespace is dropped while lexing unless keep_spaces is set
+TokenBuffer lex_file(const SourceCode& file, bool keep_spaces = false);
+// Smallest chunk lex_file_parallel splits a document into by default
+constexpr size_t min_lex_chunk = size_t(1) << 20;
+// Split large documents into chunks at newlines and lex them on up to `jobs` threads. Kinds,
+// offsets and lengths are identical to lex_file and every token names the same symbol, but the
+// chunks intern names in whatever order their threads reach them, so the ids given to names new to
+// the table may differ between runs. Documents smaller than two chunks are lexed serially.
+TokenBuffer lex_file_parallel(const SourceCode& file,
+                              size_t            jobs,
+                              bool              keep_spaces    = false,
+                              size_t            min_chunk_size = min_lex_chunk);
+// Load every file, one SourceCode per path in order. Failures are not reported here, they are left
+// in the load_error of the file for whoever compiles it.
 std::vector<SourceCode> read_raw_file(const std::vector<std::filesystem::path>& file_paths);
-std::vector<std::tuple<Lexeme, Location>>
-filter_spaces(std::vector<std::tuple<Lexeme, Location>> lexemes);
+// Remove whitespace in place from a buffer lexed with keep_spaces
+void filter_spaces(TokenBuffer& lexemes);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of workers to use when the user did not ask for a specific count
+inline size_t default_jobs() {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Run task(i) for every i in [0, count) on up to `jobs` threads. Work is handed out one index at a
+// time so uneven items balance themselves, callers store results by index to keep them ordered.
+template <typename Task>
+void parallel_for(size_t count, size_t jobs, Task&& task) {
+    jobs = std::min(std::max<size_t>(jobs, 1), count);
+    if(jobs <= 1) {
+        for(size_t i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto                worker = [&]() {
+        for(size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            task(i);
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(jobs - 1);
+    for(size_t j = 1; j < jobs; j++) {
+        workers.emplace_back(worker);
+    }
+    // The calling thread works too
+    worker();
+    for(auto& thread : workers) {
+        thread.join();
+    }
+}
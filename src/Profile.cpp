@@ -0,0 +1,205 @@
+#include "Profile.hpp"
+#include "Allocation.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <tuple>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RAJ_HAVE_THREAD_CPUTIME
+#include <time.h>
+#endif
+
+namespace {
+
+void write_escaped(std::ostream& out, std::string_view text) {
+    for(char c : text) {
+        if(c == '"' || c == '\\') {
+            out << '\\' << c;
+        }
+        else if(static_cast<unsigned char>(c) < 0x20) {
+            char escaped[7];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        }
+        else {
+            out << c;
+        }
+    }
+}
+
+void write_row(std::ostream&      out,
+               const std::string& phase,
+               const std::string& file,
+               int64_t            wall,
+               int64_t            cpu,
+               const PhaseCounts& counts) {
+    double seconds = static_cast<double>(wall) / 1e9;
+    char   line[256];
+    std::snprintf(line,
+                  sizeof(line),
+                  "%-14s %10.3f %10.3f %12llu %10llu %10llu %10.1f  ",
+                  phase.c_str(),
+                  static_cast<double>(wall) / 1e6,
+                  static_cast<double>(cpu) / 1e6,
+                  static_cast<unsigned long long>(counts.bytes),
+                  static_cast<unsigned long long>(counts.tokens),
+                  static_cast<unsigned long long>(counts.nodes),
+                  seconds > 0 ? static_cast<double>(counts.bytes) / seconds / (1 << 20) : 0.0);
+    out << line << file << '\n';
+}
+
+} // namespace
+
+Profiler& Profiler::global() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() {
+    this->epoch = std::chrono::steady_clock::now();
+}
+
+void Profiler::enable() {
+    global();
+    active.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::record(PhaseEvent event) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->recorded.push_back(std::move(event));
+}
+
+std::vector<PhaseEvent> Profiler::events() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->recorded;
+}
+
+int64_t Profiler::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                this->epoch)
+        .count();
+}
+
+int64_t Profiler::thread_cpu() {
+#ifdef RAJ_HAVE_THREAD_CPUTIME
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+#else
+    // Process time, only meaningful for runs on one thread
+    return static_cast<int64_t>(std::clock()) * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+void Profiler::write_report(std::ostream& out) const {
+    std::vector<PhaseEvent> events = this->events();
+    std::sort(events.begin(), events.end(), [](const PhaseEvent& a, const PhaseEvent& b) {
+        return a.start < b.start;
+    });
+    // Phases are summed in the order they first ran, so the aggregate reads like a compile
+    std::vector<std::string>                                         order;
+    std::map<std::string, std::tuple<int64_t, int64_t, PhaseCounts>> totals;
+    for(const PhaseEvent& event : events) {
+        auto found = totals.find(event.phase);
+        if(found == totals.end()) {
+            order.push_back(event.phase);
+            found = totals.emplace(event.phase, std::make_tuple(0, 0, PhaseCounts())).first;
+        }
+        auto& [wall, cpu, counts] = found->second;
+        wall += event.wall;
+        cpu += event.cpu;
+        counts.bytes += event.counts.bytes;
+        counts.tokens += event.counts.tokens;
+        counts.nodes += event.counts.nodes;
+    }
+
+    out << "Time report, times in ms, throughput in MiB/s\n";
+    char header[256];
+    std::snprintf(header,
+                  sizeof(header),
+                  "%-14s %10s %10s %12s %10s %10s %10s  %s\n",
+                  "phase",
+                  "wall",
+                  "cpu",
+                  "bytes",
+                  "tokens",
+                  "nodes",
+                  "MiB/s",
+                  "file");
+    out << header;
+    std::stable_sort(events.begin(), events.end(), [](const PhaseEvent& a, const PhaseEvent& b) {
+        return a.file < b.file;
+    });
+    for(const PhaseEvent& event : events) {
+        write_row(out, event.phase, event.file, event.wall, event.cpu, event.counts);
+    }
+    // Times are summed over threads, a parallel run has more phase time than wall time
+    for(const std::string& phase : order) {
+        const auto& [wall, cpu, counts] = totals[phase];
+        write_row(out, phase, "(all files)", wall, cpu, counts);
+    }
+}
+
+void Profiler::write_trace(std::ostream& out) const {
+    std::vector<PhaseEvent>             events = this->events();
+    std::map<std::thread::id, uint32_t> threads;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for(const PhaseEvent& event : events) {
+        // Small thread numbers in the order the threads first recorded
+        auto thread = threads.emplace(event.thread, static_cast<uint32_t>(threads.size())).first;
+        out << (first ? "" : ",") << "\n{\"name\":\"" << event.phase
+            << "\",\"cat\":\"raj\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->second
+            << ",\"ts\":" << static_cast<double>(event.start) / 1e3
+            << ",\"dur\":" << static_cast<double>(event.wall) / 1e3 << ",\"args\":{\"file\":\"";
+        write_escaped(out, event.file);
+        out << "\",\"cpu_us\":" << static_cast<double>(event.cpu) / 1e3
+            << ",\"bytes\":" << event.counts.bytes << ",\"tokens\":" << event.counts.tokens
+            << ",\"nodes\":" << event.counts.nodes << "}}";
+        first = false;
+    }
+    out << "\n]}\n";
+}
+
+ProfileFile::ProfileFile(const std::filesystem::path& path) {
+    this->file         = Profiler::enabled() ? path.string() : std::string();
+    this->outer        = currentProfileFile;
+    currentProfileFile = this->file;
+}
+
+ProfileFile::~ProfileFile() {
+    currentProfileFile = this->outer;
+}
+
+PhaseProbe::PhaseProbe(const char* phase) {
+    this->phase     = phase;
+    this->recording = Profiler::enabled();
+    this->start     = this->recording ? Profiler::global().now() : 0;
+    this->cpu_start = this->recording ? Profiler::thread_cpu() : 0;
+    this->outer_allocation_phase =
+        AllocationTracker::enabled()
+            ? AllocationTracker::enter(AllocationTracker::phase_slot(phase))
+            : AllocationTracker::untracked;
+}
+
+PhaseProbe::~PhaseProbe() {
+    if(this->outer_allocation_phase != AllocationTracker::untracked) {
+        AllocationTracker::leave(this->outer_allocation_phase);
+    }
+    if(!this->recording) {
+        return;
+    }
+    Profiler&  profiler = Profiler::global();
+    PhaseEvent event;
+    event.phase  = this->phase;
+    event.file   = std::string(currentProfileFile);
+    event.thread = std::this_thread::get_id();
+    event.start  = this->start;
+    event.wall   = profiler.now() - this->start;
+    event.cpu    = Profiler::thread_cpu() - this->cpu_start;
+    event.counts = this->counts;
+    profiler.record(std::move(event));
+}
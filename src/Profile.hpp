@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Phase probes are compiled in unless the build turns them off, they then record only once a run
+// asks for a time report or a trace
+#ifndef RAJ_PROFILING
+#define RAJ_PROFILING 1
+#endif
+
+class PhaseCounts {
+public:
+    // Work done by one phase, for throughput
+    uint64_t bytes  = 0;
+    uint64_t tokens = 0;
+    uint64_t nodes  = 0;
+};
+
+class PhaseEvent {
+public:
+    const char*     phase;
+    std::string     file; // Empty for work that is not about a single file
+    std::thread::id thread;
+    int64_t         start; // Nanoseconds since the profiler was made
+    int64_t         wall; // Nanoseconds
+    int64_t         cpu; // Nanoseconds of the thread that ran the phase
+    PhaseCounts     counts;
+};
+
+class Profiler {
+public:
+    // Phases recorded by the whole process
+    static Profiler& global();
+
+    // Probes record nothing until the profiler is enabled
+    static void enable();
+    static bool enabled() {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    void                                  record(PhaseEvent event);
+    [[nodiscard]] std::vector<PhaseEvent> events() const;
+    [[nodiscard]] int64_t                 now() const;
+    // CPU time of the calling thread in nanoseconds
+    [[nodiscard]] static int64_t          thread_cpu();
+
+    // Wall and CPU time, counts and throughput of every phase per file, then per phase over all
+    // files
+    void write_report(std::ostream& out) const;
+    // Chrome trace event format, one complete event per phase on the thread that ran it
+    void write_trace(std::ostream& out) const;
+
+private:
+    static inline std::atomic<bool>       active{false};
+    std::chrono::steady_clock::time_point epoch;
+    mutable std::mutex                    mutex;
+    std::vector<PhaseEvent>               recorded;
+
+    Profiler();
+};
+
+// File the phases run by this thread are attributed to, set by the driver around each file
+inline thread_local std::string_view currentProfileFile;
+
+class ProfileFile {
+public:
+    // Attributes the phases of this thread to a file until the end of the scope
+    explicit ProfileFile(const std::filesystem::path& path);
+    ProfileFile(const ProfileFile&)            = delete;
+    ProfileFile& operator=(const ProfileFile&) = delete;
+    ~ProfileFile();
+
+private:
+    std::string      file;
+    std::string_view outer;
+};
+
+class PhaseProbe {
+public:
+    // Times the scope it lives in as one phase, the allocations made in it are counted towards
+    // the phase when allocations are tracked
+    explicit PhaseProbe(const char* phase);
+    PhaseProbe(const PhaseProbe&)            = delete;
+    PhaseProbe& operator=(const PhaseProbe&) = delete;
+    ~PhaseProbe();
+
+    PhaseCounts counts;
+
+private:
+    const char* phase;
+    bool        recording;
+    int64_t     start;
+    int64_t     cpu_start;
+    uint32_t    outer_allocation_phase;
+};
+
+// Without RAJ_PROFILING neither the probe nor the counted expressions are compiled
+#if RAJ_PROFILING
+#define PROFILE_SCOPE(probe, phase)        PhaseProbe probe(phase)
+#define PROFILE_COUNT(probe, field, value) probe.counts.field = (value)
+#define PROFILE_FILE(scope, path)          ProfileFile scope(path)
+#else
+#define PROFILE_SCOPE(probe, phase)
+#define PROFILE_COUNT(probe, field, value)
+#define PROFILE_FILE(scope, path)
+#endif
@@ -0,0 +1,251 @@
+#include "Resolve.hpp"
+#include "logging.hpp"
+
+SymbolMap::SymbolMap() {
+    this->count = 0;
+}
+
+size_t SymbolMap::slot(Symbol symbol) const {
+    // Fibonacci hashing, the top bits of the product are the best mixed
+    return (static_cast<uint32_t>(symbol * 2654435769u) >> 8) & (this->keys.size() - 1);
+}
+
+uint32_t SymbolMap::find(Symbol symbol) const {
+    // Linear probing, the table is at most half full so a free slot ends every probe
+    if(this->keys.empty()) {
+        return no_binding;
+    }
+    size_t mask = this->keys.size() - 1;
+    for(size_t slot = this->slot(symbol);; slot = (slot + 1) & mask) {
+        if(this->keys[slot] == symbol) {
+            return this->values[slot];
+        }
+        if(this->keys[slot] == no_symbol) {
+            return no_binding;
+        }
+    }
+}
+
+void SymbolMap::assign(Symbol symbol, uint32_t value) {
+    if((this->count + 1) * 2 > this->keys.size()) {
+        this->grow();
+    }
+    size_t mask = this->keys.size() - 1;
+    size_t slot = this->slot(symbol);
+    while(this->keys[slot] != symbol && this->keys[slot] != no_symbol) {
+        slot = (slot + 1) & mask;
+    }
+    if(this->keys[slot] == no_symbol) {
+        this->keys[slot] = symbol;
+        this->count++;
+    }
+    this->values[slot] = value;
+}
+
+size_t SymbolMap::size() const {
+    return this->count;
+}
+
+void SymbolMap::grow() {
+    std::vector<Symbol>   old_keys   = std::move(this->keys);
+    std::vector<uint32_t> old_values = std::move(this->values);
+    // Most scopes hold a handful of names
+    size_t capacity = old_keys.empty() ? 8 : old_keys.size() * 2;
+    this->keys.assign(capacity, no_symbol);
+    this->values.assign(capacity, no_binding);
+    size_t mask = capacity - 1;
+    for(size_t i = 0; i < old_keys.size(); i++) {
+        if(old_keys[i] != no_symbol) {
+            size_t slot = this->slot(old_keys[i]);
+            while(this->keys[slot] != no_symbol) {
+                slot = (slot + 1) & mask;
+            }
+            this->keys[slot]   = old_keys[i];
+            this->values[slot] = old_values[i];
+        }
+    }
+}
+
+vertex_t ScopeTree::lookup(uint32_t scope, Symbol symbol) const {
+    for(; scope != no_binding; scope = this->scopes[scope].parent) {
+        uint32_t binding = this->scopes[scope].names.find(symbol);
+        if(binding != no_binding) {
+            return this->bindings[binding].declaration;
+        }
+    }
+    return no_vertex;
+}
+
+namespace {
+
+class Resolver {
+public:
+    // Walks the tree once. Besides the table of each scope, the bindings visible at the current
+    // point of the walk are kept in one table keyed by symbol, so a use is resolved with a single
+    // probe however deeply it is nested. Leaving a scope undoes its declarations, bringing back
+    // the bindings they shadowed.
+    Tree&                 ast;
+    ScopeTree&            scopes;
+    SymbolMap             visible;
+    std::vector<uint32_t> undo; // Bindings in the order they became visible
+    size_t                unresolved;
+
+    Resolver(Tree& ast, ScopeTree& scopes) : ast(ast), scopes(scopes) {
+        this->unresolved = 0;
+    }
+
+    uint32_t enter(vertex_t node, uint32_t parent) {
+        auto scope = static_cast<uint32_t>(this->scopes.scopes.size());
+        this->scopes.scopes.push_back(Scope{node, parent, SymbolMap()});
+        // Functions may be called before the statement that declares them
+        for(vertex_t child = this->ast.first_child(node); child != no_vertex;
+            child          = this->ast.next_sibling(child)) {
+            if(this->ast[child].node_class == ASTNodeClass::Function) {
+                this->declare(scope, child);
+            }
+        }
+        return scope;
+    }
+
+    void leave(size_t undo_mark) {
+        while(this->undo.size() > undo_mark) {
+            const Binding& binding = this->scopes.bindings[this->undo.back()];
+            this->visible.assign(binding.symbol, binding.shadowed);
+            this->undo.pop_back();
+        }
+    }
+
+    void declare(uint32_t scope, vertex_t declaration) {
+        Symbol symbol = this->ast[declaration].symbol;
+        if(symbol == no_symbol) {
+            // Anonymous functions and scopes
+            return;
+        }
+        auto binding = static_cast<uint32_t>(this->scopes.bindings.size());
+        this->scopes.bindings.push_back(
+            Binding{symbol, declaration, scope, this->visible.find(symbol)});
+        this->scopes.scopes[scope].names.assign(symbol, binding);
+        this->visible.assign(symbol, binding);
+        this->undo.push_back(binding);
+    }
+
+    void declare_names(uint32_t scope, vertex_t declaration) {
+        // Destructuring declares the names of its element declarations
+        for(vertex_t child = this->ast.first_child(declaration); child != no_vertex;
+            child          = this->ast.next_sibling(child)) {
+            if(this->ast[child].node_class == ASTNodeClass::Declaration) {
+                this->declare(scope, child);
+            }
+        }
+        this->declare(scope, declaration);
+    }
+
+    void use(vertex_t vertex) {
+        uint32_t binding = this->visible.find(this->ast[vertex].symbol);
+        if(binding == no_binding) {
+            LOG_WARNING("Unresolved name " << this->ast[vertex].name << " at "
+                                           << this->ast[vertex].location)
+            this->unresolved++;
+            return;
+        }
+        this->ast.bind(vertex, this->scopes.bindings[binding].declaration);
+    }
+
+    void resolve_children(vertex_t node, uint32_t scope) {
+        for(vertex_t child = this->ast.first_child(node); child != no_vertex;
+            child          = this->ast.next_sibling(child)) {
+            this->resolve(child, scope);
+        }
+    }
+
+    void resolve(vertex_t node, uint32_t scope) {
+        switch(this->ast[node].node_class) {
+        case ASTNodeClass::Root:
+        case ASTNodeClass::Function: {
+            size_t   undo_mark = this->undo.size();
+            uint32_t inner     = this->enter(node, scope);
+            this->resolve_children(node, inner);
+            this->leave(undo_mark);
+            return;
+        }
+        case ASTNodeClass::Argument:
+            this->declare(scope, node);
+            return;
+        case ASTNodeClass::Declaration: {
+            // The initial value is resolved before the names exist, let x = x refers to an outer x
+            for(vertex_t child = this->ast.first_child(node); child != no_vertex;
+                child          = this->ast.next_sibling(child)) {
+                if(this->ast[child].node_class != ASTNodeClass::Declaration) {
+                    this->resolve(child, scope);
+                }
+            }
+            this->declare_names(scope, node);
+            return;
+        }
+        case ASTNodeClass::Identifier:
+            this->use(node);
+            return;
+        case ASTNodeClass::Call: {
+            this->resolve_children(node, scope);
+            // A call of a name is bound to what the name is bound to
+            vertex_t callee = this->ast.first_child(node);
+            if(callee != no_vertex && this->ast[callee].node_class == ASTNodeClass::Identifier) {
+                this->ast.bind(node, this->ast.declaration(callee));
+            }
+            return;
+        }
+        case ASTNodeClass::Type:
+        case ASTNodeClass::Return:
+            // Types hold no names
+            return;
+        default:
+            this->resolve_children(node, scope);
+        }
+    }
+};
+
+} // namespace
+
+ScopeTree resolve_names(Tree& ast) {
+    ScopeTree scopes;
+    if(ast.size() == 0) {
+        return scopes;
+    }
+    Resolver resolver(ast, scopes);
+    resolver.resolve(0, no_binding);
+    LOG_DEBUG("Resolved names in " << scopes.scopes.size() << " scopes, " << resolver.unresolved
+                                   << " unresolved")
+    return scopes;
+}
+
+ScopeTree resolve_names(Tree& ast, vertex_t function) {
+    ScopeTree scopes;
+    Resolver  resolver(ast, scopes);
+    // Walk down from the root, every enclosing scope declares what precedes the path to function
+    std::vector<vertex_t> path;
+    for(vertex_t vertex = function; vertex != no_vertex; vertex = ast.parent(vertex)) {
+        path.push_back(vertex);
+    }
+    uint32_t scope = no_binding;
+    for(size_t i = path.size() - 1; i > 0; i--) {
+        vertex_t node = path[i];
+        if(ast[node].node_class != ASTNodeClass::Root &&
+           ast[node].node_class != ASTNodeClass::Function) {
+            continue;
+        }
+        scope = resolver.enter(node, scope);
+        for(vertex_t child = ast.first_child(node); child != path[i - 1];
+            child          = ast.next_sibling(child)) {
+            if(ast[child].node_class == ASTNodeClass::Argument) {
+                resolver.declare(scope, child);
+            }
+            else if(ast[child].node_class == ASTNodeClass::Declaration) {
+                resolver.declare_names(scope, child);
+            }
+        }
+    }
+    resolver.resolve(function, scope);
+    LOG_DEBUG("Resolved names of " << ast[function].name << ", " << resolver.unresolved
+                                   << " unresolved")
+    return scopes;
+}
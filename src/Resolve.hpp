@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AST.hpp"
+#include "Symbols.hpp"
+
+constexpr uint32_t no_binding = UINT32_MAX;
+
+class SymbolMap {
+public:
+    // Flat open addressed map from a Symbol to a 32 bit value, symbols are already well mixed ids so
+    // they are hashed with a single multiply
+    SymbolMap();
+
+    [[nodiscard]] uint32_t find(Symbol symbol) const; // no_binding when absent
+    void                   assign(Symbol symbol, uint32_t value);
+    [[nodiscard]] size_t   size() const;
+
+private:
+    std::vector<Symbol>   keys; // no_symbol marks a free slot
+    std::vector<uint32_t> values;
+    size_t                count;
+
+    [[nodiscard]] size_t slot(Symbol symbol) const;
+    void                 grow();
+};
+
+class Binding {
+public:
+    Symbol   symbol;
+    vertex_t declaration;
+    uint32_t scope;
+    uint32_t shadowed; // Binding of the same name this one hides, no_binding if none
+};
+
+class Scope {
+public:
+    vertex_t  node; // Root or Function node that opens the scope
+    uint32_t  parent; // no_binding for the root scope
+    SymbolMap names; // Last binding of each name declared directly in this scope
+};
+
+class ScopeTree {
+public:
+    // Every scope of a tree with its own table of names, linked to the scope it is nested in. Kept
+    // after resolution so later phases can ask what a name means in a given scope.
+    std::vector<Scope>   scopes; // Scope 0 is the root
+    std::vector<Binding> bindings;
+
+    // Declaration of symbol visible from scope, no_vertex when nothing declares it
+    [[nodiscard]] vertex_t lookup(uint32_t scope, Symbol symbol) const;
+};
+
+// Bind every Identifier and Call to its declaration in Tree::declarations. Functions are visible
+// throughout the scope they are declared in, arguments throughout their function and let
+// declarations from the statement after them. Inner scopes shadow outer ones. Returns the scopes.
+ScopeTree resolve_names(Tree& ast);
+// Resolve only the subtree of function, seeing what its enclosing scopes declare before it. Used
+// for bodies that are parsed after the rest of the tree was resolved.
+ScopeTree resolve_names(Tree& ast, vertex_t function);
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "Scan.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RAJ_HAVE_X86_SIMD
+#include <immintrin.h>
+#define RAJ_TARGET_AVX2 __attribute__((target("avx2")))
+#define RAJ_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+
+namespace {
+
+// Each set of bytes has a scalar test and, on x86, the same test on a whole vector. The vector
+// tests compare as signed bytes, which is fine since every range is ASCII and bytes >= 0x80 are
+// negative so never match.
+class SpaceBytes {
+public:
+    static bool scalar(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+#ifdef RAJ_HAVE_X86_SIMD
+    RAJ_TARGET_SSE2 static __m128i sse2(__m128i v) {
+        return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+    }
+    RAJ_TARGET_AVX2 static __m256i avx2(__m256i v) {
+        return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                               _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                               _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                                               _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+    }
+#endif
+};
+
+class DigitBytes {
+public:
+    static bool scalar(char c) {
+        return c >= '0' && c <= '9';
+    }
+#ifdef RAJ_HAVE_X86_SIMD
+    RAJ_TARGET_SSE2 static __m128i sse2(__m128i v) {
+        return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                             _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    }
+    RAJ_TARGET_AVX2 static __m256i avx2(__m256i v) {
+        return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    }
+#endif
+};
+
+class WordBytes {
+public:
+    static bool scalar(char c) {
+        // Setting 0x20 folds A-Z onto a-z without folding anything else onto it
+        char lower = static_cast<char>(c | 0x20);
+        return (lower >= 'a' && lower <= 'z') || DigitBytes::scalar(c) || c == '_';
+    }
+#ifdef RAJ_HAVE_X86_SIMD
+    RAJ_TARGET_SSE2 static __m128i sse2(__m128i v) {
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                      _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+        return _mm_or_si128(_mm_or_si128(alpha, DigitBytes::sse2(v)),
+                            _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    }
+    RAJ_TARGET_AVX2 static __m256i avx2(__m256i v) {
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+        return _mm256_or_si256(_mm256_or_si256(alpha, DigitBytes::avx2(v)),
+                               _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    }
+#endif
+};
+
+template <typename Bytes>
+const char* skip_scalar(const char* cursor, const char* end) {
+    while(cursor < end && Bytes::scalar(*cursor)) {
+        cursor++;
+    }
+    return cursor;
+}
+
+size_t count_newlines_scalar(std::string_view document) {
+    size_t      count  = 0;
+    const char* cursor = document.data();
+    const char* end    = cursor + document.size();
+    while((cursor = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor))) != nullptr) {
+        cursor++;
+        count++;
+    }
+    return count;
+}
+
+void append_line_starts(const char*            begin,
+                        const char*            cursor,
+                        const char*            end,
+                        std::vector<uint32_t>& line_starts) {
+    // Offsets are relative to begin, scanning starts at cursor
+    while((cursor = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor))) != nullptr) {
+        cursor++;
+        line_starts.push_back(static_cast<uint32_t>(cursor - begin));
+    }
+}
+
+void find_newlines_scalar(std::string_view document, std::vector<uint32_t>& line_starts) {
+    const char* begin = document.data();
+    append_line_starts(begin, begin, begin + document.size(), line_starts);
+}
+
+#ifdef RAJ_HAVE_X86_SIMD
+
+// A block is 16 or 32 bytes, the mask has one bit per byte that belongs to the run
+template <typename Bytes>
+RAJ_TARGET_SSE2 const char* skip_sse2(const char* cursor, const char* end) {
+    while(end - cursor >= 16) {
+        __m128i  block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+        uint32_t run   = static_cast<uint32_t>(_mm_movemask_epi8(Bytes::sse2(block)));
+        if(run != 0xFFFF) {
+            return cursor + __builtin_ctz(~run);
+        }
+        cursor += 16;
+    }
+    return skip_scalar<Bytes>(cursor, end);
+}
+
+template <typename Bytes>
+RAJ_TARGET_AVX2 const char* skip_avx2(const char* cursor, const char* end) {
+    while(end - cursor >= 32) {
+        __m256i  block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cursor));
+        uint32_t run   = static_cast<uint32_t>(_mm256_movemask_epi8(Bytes::avx2(block)));
+        if(run != 0xFFFFFFFF) {
+            return cursor + __builtin_ctz(~run);
+        }
+        cursor += 32;
+    }
+    return skip_scalar<Bytes>(cursor, end);
+}
+
+RAJ_TARGET_SSE2 size_t count_newlines_sse2(std::string_view document) {
+    const char* cursor  = document.data();
+    const char* end     = cursor + document.size();
+    size_t      count   = 0;
+    __m128i     newline = _mm_set1_epi8('\n');
+    for(; end - cursor >= 16; cursor += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+    }
+    return count + count_newlines_scalar(std::string_view(cursor, end - cursor));
+}
+
+RAJ_TARGET_AVX2 size_t count_newlines_avx2(std::string_view document) {
+    const char* cursor  = document.data();
+    const char* end     = cursor + document.size();
+    size_t      count   = 0;
+    __m256i     newline = _mm256_set1_epi8('\n');
+    for(; end - cursor >= 32; cursor += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cursor));
+        count += __builtin_popcount(
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline))));
+    }
+    return count + count_newlines_scalar(std::string_view(cursor, end - cursor));
+}
+
+void push_line_starts(uint32_t mask, uint32_t block_offset, std::vector<uint32_t>& line_starts) {
+    while(mask != 0) {
+        line_starts.push_back(block_offset + __builtin_ctz(mask) + 1);
+        mask &= mask - 1;
+    }
+}
+
+RAJ_TARGET_SSE2 void find_newlines_sse2(std::string_view document,
+                                        std::vector<uint32_t>& line_starts) {
+    const char* begin   = document.data();
+    const char* end     = begin + document.size();
+    const char* cursor  = begin;
+    __m128i     newline = _mm_set1_epi8('\n');
+    for(; end - cursor >= 16; cursor += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+        push_line_starts(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline))),
+                         static_cast<uint32_t>(cursor - begin),
+                         line_starts);
+    }
+    append_line_starts(begin, cursor, end, line_starts);
+}
+
+RAJ_TARGET_AVX2 void find_newlines_avx2(std::string_view document,
+                                        std::vector<uint32_t>& line_starts) {
+    const char* begin   = document.data();
+    const char* end     = begin + document.size();
+    const char* cursor  = begin;
+    __m256i     newline = _mm256_set1_epi8('\n');
+    for(; end - cursor >= 32; cursor += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cursor));
+        push_line_starts(
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline))),
+            static_cast<uint32_t>(cursor - begin),
+            line_starts);
+    }
+    append_line_starts(begin, cursor, end, line_starts);
+}
+
+#endif
+
+class ScanKernels {
+public:
+    const char* (*skip_spaces)(const char*, const char*);
+    const char* (*skip_word)(const char*, const char*);
+    const char* (*skip_digits)(const char*, const char*);
+    size_t (*count_newlines)(std::string_view);
+    void (*find_newlines)(std::string_view, std::vector<uint32_t>&);
+};
+
+constexpr ScanKernels scalar_kernels = {
+    skip_scalar<SpaceBytes>,
+    skip_scalar<WordBytes>,
+    skip_scalar<DigitBytes>,
+    count_newlines_scalar,
+    find_newlines_scalar,
+};
+
+#ifdef RAJ_HAVE_X86_SIMD
+constexpr ScanKernels sse2_kernels = {
+    skip_sse2<SpaceBytes>,
+    skip_sse2<WordBytes>,
+    skip_sse2<DigitBytes>,
+    count_newlines_sse2,
+    find_newlines_sse2,
+};
+
+constexpr ScanKernels avx2_kernels = {
+    skip_avx2<SpaceBytes>,
+    skip_avx2<WordBytes>,
+    skip_avx2<DigitBytes>,
+    count_newlines_avx2,
+    find_newlines_avx2,
+};
+#endif
+
+const ScanKernels* kernels_for(ScanLevel level) {
+#ifdef RAJ_HAVE_X86_SIMD
+    switch(level) {
+    case ScanLevel::AVX2:
+        return &avx2_kernels;
+    case ScanLevel::SSE2:
+        return &sse2_kernels;
+    case ScanLevel::Scalar:
+        break;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+std::atomic<ScanLevel>& active_level() {
+    static std::atomic<ScanLevel> level{detect_scan_level()};
+    return level;
+}
+
+const ScanKernels& active_kernels() {
+    return *kernels_for(active_level().load(std::memory_order_relaxed));
+}
+
+} // namespace
+
+ScanLevel detect_scan_level() {
+#ifdef RAJ_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return ScanLevel::AVX2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return ScanLevel::SSE2;
+    }
+#endif
+    return ScanLevel::Scalar;
+}
+
+ScanLevel scan_level() {
+    return active_level().load(std::memory_order_relaxed);
+}
+
+void set_scan_level(ScanLevel level) {
+    active_level().store(std::min(level, detect_scan_level()), std::memory_order_relaxed);
+}
+
+const char* skip_spaces(const char* cursor, const char* end) {
+    return active_kernels().skip_spaces(cursor, end);
+}
+
+const char* skip_word(const char* cursor, const char* end) {
+    return active_kernels().skip_word(cursor, end);
+}
+
+const char* skip_digits(const char* cursor, const char* end) {
+    return active_kernels().skip_digits(cursor, end);
+}
+
+size_t count_newlines(std::string_view document) {
+    return active_kernels().count_newlines(document);
+}
+
+void find_newlines(std::string_view document, std::vector<uint32_t>& line_starts) {
+    active_kernels().find_newlines(document, line_starts);
+}
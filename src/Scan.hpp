@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Vectorised scanning kernels used by the lexer and the line index. The widest instruction set the
+// CPU supports is picked at runtime, every level gives exactly the same results.
+enum class ScanLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// Best level this CPU supports
+ScanLevel detect_scan_level();
+ScanLevel scan_level();
+// Force a level, used by tests and benchmarks to compare the kernels. Levels the CPU does not
+// support fall back to the best one it does.
+void set_scan_level(ScanLevel level);
+
+// First position in [cursor, end) that is not part of the run, or end
+const char* skip_spaces(const char* cursor, const char* end); // ' ', \t, \r, \n
+const char* skip_word(const char* cursor, const char* end); // a-z, A-Z, 0-9, _
+const char* skip_digits(const char* cursor, const char* end); // 0-9
+
+// Number of '\n' in the document
+size_t count_newlines(std::string_view document);
+// Append the offset just past every '\n' in the document
+void find_newlines(std::string_view document, std::vector<uint32_t>& line_starts);
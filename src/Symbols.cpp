@@ -0,0 +1,166 @@
+#include "Symbols.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+uint64_t mix(uint64_t x) {
+    // Finaliser of splitmix64
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+thread_local SymbolTable* current_table = nullptr;
+std::atomic<uint64_t>     next_generation{1};
+
+} // namespace
+
+SymbolTable::SymbolTable() {
+    this->generation = next_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+SymbolTable& SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolTable& SymbolTable::current() {
+    return current_table != nullptr ? *current_table : global();
+}
+
+SymbolTable* SymbolTable::use(SymbolTable* table) {
+    SymbolTable* previous = current_table;
+    current_table         = table;
+    return previous;
+}
+
+uint64_t SymbolTable::hash(std::string_view text, uint64_t seed) {
+    // Identifiers are short, they are read 8 bytes at a time rather than byte by byte
+    uint64_t    h    = seed ^ text.length();
+    const char* data = text.data();
+    size_t      i    = 0;
+    for(; i + 8 <= text.length(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        h = mix(h ^ word);
+    }
+    if(i < text.length()) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + i, text.length() - i);
+        h = mix(h ^ word);
+    }
+    return h;
+}
+
+uint32_t SymbolTable::Shard::find(std::string_view name, uint32_t hash) const {
+    // Linear probing, the index is at most half full so a free slot ends every probe
+    if(this->slots.empty()) {
+        return no_symbol;
+    }
+    size_t mask = this->slots.size() - 1;
+    for(size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        const Slot& candidate = this->slots[slot];
+        if(candidate.index == no_symbol) {
+            return no_symbol;
+        }
+        if(candidate.hash == hash && this->names[candidate.index] == name) {
+            return candidate.index;
+        }
+    }
+}
+
+void SymbolTable::Shard::insert(Slot entry) {
+    size_t mask = this->slots.size() - 1;
+    size_t slot = entry.hash & mask;
+    while(this->slots[slot].index != no_symbol) {
+        slot = (slot + 1) & mask;
+    }
+    this->slots[slot] = entry;
+}
+
+Symbol SymbolTable::intern(std::string_view name) {
+    // Each thread remembers the names it interned last in a small direct mapped cache, a hit needs
+    // no lock at all. Entries are keyed by the table's generation rather than its address, so the
+    // cached text, the pool's own copy, is only read while its table is alive.
+    class CacheEntry {
+    public:
+        uint64_t         generation = 0;
+        uint64_t         hash       = 0;
+        Symbol           symbol;
+        std::string_view name;
+    };
+    static thread_local std::array<CacheEntry, 1024> cache;
+
+    uint64_t    h      = hash(name);
+    CacheEntry& cached = cache[h & (cache.size() - 1)];
+    if(cached.generation == this->generation && cached.hash == h && cached.name == name) {
+        return cached.symbol;
+    }
+    std::string_view stored;
+    Symbol           symbol = this->intern(name, h, stored);
+    cached                  = CacheEntry{this->generation, h, symbol, stored};
+    return symbol;
+}
+
+Symbol SymbolTable::intern(std::string_view name, uint64_t h, std::string_view& stored) {
+    // The top bits of the hash pick the shard, the low bits the slot within it
+    size_t shard_index = h >> (64 - shard_bits);
+    auto   low         = static_cast<uint32_t>(h);
+    Shard& shard       = this->shards[shard_index];
+    {
+        // Most identifiers are seen many times, the first sighting is the only one that writes
+        std::shared_lock lock(shard.mutex);
+        uint32_t         index = shard.find(name, low);
+        if(index != no_symbol) {
+            stored = shard.names[index];
+            return (index << shard_bits) | static_cast<Symbol>(shard_index);
+        }
+    }
+    std::unique_lock lock(shard.mutex);
+    // Another thread may have added it between the locks
+    uint32_t index = shard.find(name, low);
+    if(index == no_symbol) {
+        if(shard.names.size() >= (no_symbol >> shard_bits)) {
+            LOG_ERROR("Symbol table shard " << shard_index << " is full")
+            throw std::runtime_error("Too many symbols");
+        }
+        index = static_cast<uint32_t>(shard.names.size());
+        shard.names.push_back(shard.text.store(name));
+        if(shard.names.size() * 2 > shard.slots.size()) {
+            // Rebuild the index at twice the size
+            std::vector<Slot> old = std::move(shard.slots);
+            shard.slots.assign(std::max<size_t>(64, old.size() * 2), Slot{0, no_symbol});
+            for(const Slot& entry : old) {
+                if(entry.index != no_symbol) {
+                    shard.insert(entry);
+                }
+            }
+        }
+        shard.insert(Slot{low, index});
+    }
+    stored = shard.names[index];
+    return (index << shard_bits) | static_cast<Symbol>(shard_index);
+}
+
+std::string_view SymbolTable::name(Symbol symbol) const {
+    const Shard&     shard = this->shards[symbol & (shard_count - 1)];
+    std::shared_lock lock(shard.mutex);
+    return shard.names.at(symbol >> shard_bits);
+}
+
+size_t SymbolTable::size() const {
+    size_t total = 0;
+    for(const Shard& shard : this->shards) {
+        std::shared_lock lock(shard.mutex);
+        total += shard.names.size();
+    }
+    return total;
+}
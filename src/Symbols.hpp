@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+#include "Arena.hpp"
+
+typedef uint32_t Symbol;
+constexpr Symbol no_symbol = UINT32_MAX;
+
+class SymbolTable {
+public:
+    // Pool of identifier names. Every distinct name is stored once and given a stable 32 bit
+    // Symbol, so names compare and hash as integers. The pool is split into shards by hash, each
+    // with its own lock, so files lexed in parallel rarely wait on each other. Each compiler
+    // context has a table of its own, global() is used outside of any.
+    SymbolTable();
+    SymbolTable(const SymbolTable&)            = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    static SymbolTable& global();
+    // Table of the compilation running on this thread, the global one outside of any
+    static SymbolTable& current();
+    // Make table the current one of this thread, nullptr for the global one. Returns the table
+    // it replaces.
+    static SymbolTable* use(SymbolTable* table);
+
+    Symbol intern(std::string_view name);
+    // Text of an interned name, valid for the life of the table
+    [[nodiscard]] std::string_view name(Symbol symbol) const;
+    [[nodiscard]] size_t           size() const;
+
+    // Differently seeded hashes of the same text are independent of each other
+    static uint64_t hash(std::string_view text, uint64_t seed = 0x9e3779b97f4a7c15ull);
+
+    static constexpr size_t shard_bits  = 4;
+    static constexpr size_t shard_count = size_t(1) << shard_bits;
+
+private:
+    class Slot {
+    public:
+        uint32_t hash; // Low half of the hash, most mismatches are rejected without the text
+        uint32_t index; // Into names, no_symbol when the slot is free
+    };
+
+    class alignas(64) Shard {
+    public:
+        mutable std::shared_mutex     mutex;
+        std::vector<Slot>             slots; // Open addressed index of names
+        std::vector<std::string_view> names;
+        Arena                         text; // Owns the text of the names
+
+        [[nodiscard]] uint32_t find(std::string_view name, uint32_t hash) const;
+        void                   insert(Slot entry);
+    };
+
+    // Slow path of intern, stored is set to the pool's copy of the name
+    Symbol intern(std::string_view name, uint64_t hash, std::string_view& stored);
+
+    std::array<Shard, shard_count> shards;
+    // Unique to this table for the life of the process, a later table at the same address never
+    // hits the intern cache entries of this one
+    uint64_t                       generation;
+};
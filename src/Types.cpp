@@ -0,0 +1,215 @@
+#include "Types.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <cassert>
+
+namespace {
+
+uint32_t hash_type(ASTNodeSubType kind, const TypeId* operands, uint32_t count) {
+    // FNV-1a over the kind and the operand ids, operands are already unique so this is shallow
+    uint32_t h = 2166136261u ^ kind;
+    h *= 16777619u;
+    for(uint32_t i = 0; i < count; i++) {
+        h ^= operands[i];
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+thread_local TypeTable* current_table = nullptr;
+
+} // namespace
+
+TypeTable::TypeTable() {
+    this->slots.assign(64, no_type);
+    // Primitives are interned first so their TypeId is their sub type and needs no lookup
+    for(uint8_t kind = ASTNodeSubType::boolean; kind <= ASTNodeSubType::f64; kind++) {
+        this->intern(static_cast<ASTNodeSubType>(kind), nullptr, 0);
+    }
+}
+
+TypeTable& TypeTable::global() {
+    static TypeTable table;
+    return table;
+}
+
+TypeTable& TypeTable::current() {
+    return current_table != nullptr ? *current_table : global();
+}
+
+TypeTable* TypeTable::use(TypeTable* table) {
+    TypeTable* previous = current_table;
+    current_table       = table;
+    return previous;
+}
+
+TypeId TypeTable::primitive(ASTNodeSubType kind) const {
+    // Callers only pass the sub type of a primitive type keyword
+    assert(kind <= ASTNodeSubType::f64 && "Not a primitive type");
+    return static_cast<TypeId>(kind);
+}
+
+TypeId TypeTable::array(TypeId element) {
+    return this->intern(ASTNodeSubType::array, &element, 1);
+}
+
+TypeId TypeTable::map(TypeId key, TypeId value) {
+    TypeId operands[2] = {key, value};
+    return this->intern(ASTNodeSubType::map, operands, 2);
+}
+
+TypeId TypeTable::tuple(const std::vector<TypeId>& elements) {
+    return this->intern(
+        ASTNodeSubType::tuple, elements.data(), static_cast<uint32_t>(elements.size()));
+}
+
+TypeId TypeTable::func(const std::vector<TypeId>& parameters, TypeId result) {
+    std::vector<TypeId> operands;
+    operands.reserve(parameters.size() + 1);
+    operands.push_back(result);
+    operands.insert(operands.end(), parameters.begin(), parameters.end());
+    return this->intern(
+        ASTNodeSubType::func, operands.data(), static_cast<uint32_t>(operands.size()));
+}
+
+TypeId TypeTable::find(ASTNodeSubType kind,
+                       const TypeId*  operands,
+                       uint32_t       count,
+                       uint32_t       hash) const {
+    // Linear probing, the table is at most half full so a free slot ends every probe
+    size_t mask = this->slots.size() - 1;
+    for(size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        TypeId candidate = this->slots[slot];
+        if(candidate == no_type) {
+            return no_type;
+        }
+        const Entry& entry = this->entries[candidate];
+        auto first = this->operand_pool.begin() + entry.first_operand;
+        if(entry.hash == hash && entry.kind == kind && entry.operand_count == count &&
+           std::equal(operands, operands + count, first)) {
+            return candidate;
+        }
+    }
+}
+
+void TypeTable::grow() {
+    std::vector<TypeId> grown(this->slots.size() * 2, no_type);
+    size_t              mask = grown.size() - 1;
+    for(TypeId type = 0; type < this->entries.size(); type++) {
+        size_t slot = this->entries[type].hash & mask;
+        while(grown[slot] != no_type) {
+            slot = (slot + 1) & mask;
+        }
+        grown[slot] = type;
+    }
+    this->slots = std::move(grown);
+}
+
+TypeId TypeTable::intern(ASTNodeSubType kind, const TypeId* operands, uint32_t count) {
+    uint32_t hash = hash_type(kind, operands, count);
+    {
+        // Almost every type of a program is already interned, only readers contend here
+        std::shared_lock lock(this->mutex);
+        TypeId           existing = this->find(kind, operands, count, hash);
+        if(existing != no_type) {
+            return existing;
+        }
+    }
+    std::unique_lock lock(this->mutex);
+    // Another thread may have added it between the locks
+    TypeId existing = this->find(kind, operands, count, hash);
+    if(existing != no_type) {
+        return existing;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        // Operands come from this table, a foreign TypeId is a bug in the caller
+        assert(operands[i] < this->entries.size() && "Unknown TypeId");
+    }
+    auto type = static_cast<TypeId>(this->entries.size());
+    this->entries.push_back({kind, static_cast<uint32_t>(this->operand_pool.size()), count, hash});
+    this->operand_pool.insert(this->operand_pool.end(), operands, operands + count);
+    if(this->entries.size() * 2 > this->slots.size()) {
+        this->grow();
+    }
+    else {
+        size_t mask = this->slots.size() - 1;
+        size_t slot = hash & mask;
+        while(this->slots[slot] != no_type) {
+            slot = (slot + 1) & mask;
+        }
+        this->slots[slot] = type;
+    }
+    return type;
+}
+
+ASTNodeSubType TypeTable::kind(TypeId type) const {
+    std::shared_lock lock(this->mutex);
+    return this->entries.at(type).kind;
+}
+
+std::vector<TypeId> TypeTable::operands(TypeId type) const {
+    std::shared_lock lock(this->mutex);
+    const Entry&     entry = this->entries.at(type);
+    auto             first = this->operand_pool.begin() + entry.first_operand;
+    return {first, first + entry.operand_count};
+}
+
+size_t TypeTable::size() const {
+    std::shared_lock lock(this->mutex);
+    return this->entries.size();
+}
+
+std::string_view TypeTable::kind_name(ASTNodeSubType kind) {
+    for(const KeywordSpec& spec : keyword_specs) {
+        if(spec.sub_type == kind) {
+            return spec.name;
+        }
+    }
+    return kind == ASTNodeSubType::tuple ? "tuple" : "none";
+}
+
+void TypeTable::append_string(TypeId type, std::string& out) const {
+    const Entry&  entry   = this->entries[type];
+    const TypeId* operand = this->operand_pool.data() + entry.first_operand;
+    switch(entry.kind) {
+    case ASTNodeSubType::array:
+    case ASTNodeSubType::map:
+        out += this->kind_name(entry.kind);
+        out += '<';
+        for(uint32_t i = 0; i < entry.operand_count; i++) {
+            out += (i == 0 ? "" : ", ");
+            this->append_string(operand[i], out);
+        }
+        out += '>';
+        break;
+    case ASTNodeSubType::tuple:
+        out += '(';
+        for(uint32_t i = 0; i < entry.operand_count; i++) {
+            out += (i == 0 ? "" : ", ");
+            this->append_string(operand[i], out);
+        }
+        out += ')';
+        break;
+    case ASTNodeSubType::func:
+        // The result is stored first but written last
+        out += "func<";
+        for(uint32_t i = 1; i < entry.operand_count; i++) {
+            out += (i == 1 ? "" : ", ");
+            this->append_string(operand[i], out);
+        }
+        out += "> -> ";
+        this->append_string(operand[0], out);
+        break;
+    default:
+        out += this->kind_name(entry.kind);
+    }
+}
+
+std::string TypeTable::to_string(TypeId type) const {
+    std::shared_lock lock(this->mutex);
+    std::string      out;
+    this->append_string(type, out);
+    return out;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Keywords.hpp"
+
+typedef uint32_t TypeId;
+constexpr TypeId no_type = UINT32_MAX;
+
+class TypeTable {
+public:
+    // Table of hash-consed types. Structurally equal types are stored once, so two types are
+    // equal exactly when their TypeIds are. Safe to use from several threads. Each compiler
+    // context has a table of its own, global() is used outside of any. Primitives have the same
+    // TypeId in every table.
+    TypeTable();
+    TypeTable(const TypeTable&)            = delete;
+    TypeTable& operator=(const TypeTable&) = delete;
+
+    static TypeTable& global();
+    // Table of the compilation running on this thread, the global one outside of any
+    static TypeTable& current();
+    // Make table the current one of this thread, nullptr for the global one. Returns the table it
+    // replaces.
+    static TypeTable* use(TypeTable* table);
+
+    [[nodiscard]] TypeId primitive(ASTNodeSubType kind) const;
+    TypeId               array(TypeId element);
+    TypeId               map(TypeId key, TypeId value);
+    TypeId               tuple(const std::vector<TypeId>& elements);
+    TypeId               func(const std::vector<TypeId>& parameters, TypeId result);
+    // Find or add the type made of kind and operands
+    TypeId intern(ASTNodeSubType kind, const TypeId* operands, uint32_t count);
+
+    [[nodiscard]] ASTNodeSubType kind(TypeId type) const;
+    // array: element, map: key and value, tuple: elements, func: result then parameters
+    [[nodiscard]] std::vector<TypeId> operands(TypeId type) const;
+    [[nodiscard]] std::string         to_string(TypeId type) const;
+    [[nodiscard]] size_t              size() const;
+
+    // Spelling of a type kind, "i1" for signed and "u1" for unsigned booleans
+    static std::string_view kind_name(ASTNodeSubType kind);
+
+private:
+    class Entry {
+    public:
+        ASTNodeSubType kind;
+        uint32_t       first_operand;
+        uint32_t       operand_count;
+        uint32_t       hash;
+    };
+
+    [[nodiscard]] TypeId find(ASTNodeSubType kind, const TypeId* operands, uint32_t count, uint32_t hash) const;
+    void                 grow();
+    void                 append_string(TypeId type, std::string& out) const;
+
+    mutable std::shared_mutex mutex;
+    std::vector<Entry>        entries;
+    std::vector<TypeId>       operand_pool; // Operands of every entry back to back
+    std::vector<TypeId>       slots; // Open addressed index of entries by hash, no_type when free
+};
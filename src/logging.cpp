@@ -0,0 +1,149 @@
+#include "logging.hpp"
+
+#include <chrono>
+
+Logger& Logger::global() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() {
+    this->slots = std::make_unique<Slot[]>(capacity);
+    for(size_t i = 0; i < capacity; i++) {
+        this->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    this->tail     = 0;
+    this->written  = 0;
+    this->idle     = false;
+    this->stopping = false;
+    this->flushing = 0;
+    this->drain    = std::thread(&Logger::drain_loop, this);
+}
+
+Logger::~Logger() {
+    // Lines logged before exit are still written
+    this->stopping = true;
+    this->wake.notify_one();
+    this->drain.join();
+}
+
+void Logger::set_level(LogLevel level) {
+    threshold.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+LogLevel Logger::level() {
+    return static_cast<LogLevel>(threshold.load(std::memory_order_relaxed));
+}
+
+void Logger::write(LogLevel level, std::string line) {
+    // Bounded multi producer ring, a slot is free for position p once its sequence reaches p and
+    // holds a line once it reaches p + 1
+    uint64_t position = this->tail.load(std::memory_order_relaxed);
+    Slot*    slot;
+    while(true) {
+        slot              = &this->slots[position & (capacity - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t  distance = static_cast<int64_t>(sequence - position);
+        if(distance == 0) {
+            if(this->tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if(distance < 0) {
+            // Full, the drain frees slots as it writes
+            this->wake.notify_one();
+            std::this_thread::yield();
+            position = this->tail.load(std::memory_order_relaxed);
+        }
+        else {
+            position = this->tail.load(std::memory_order_relaxed);
+        }
+    }
+    slot->level = level;
+    slot->line  = std::move(line);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    if(this->idle.load(std::memory_order_relaxed)) {
+        this->wake.notify_one();
+    }
+}
+
+void Logger::flush() {
+    uint64_t target = this->tail.load(std::memory_order_acquire);
+    if(this->written.load(std::memory_order_acquire) >= target) {
+        return;
+    }
+    // Sleeps until the drain has written the lines, it only signals while someone is waiting
+    this->flushing++;
+    this->wake.notify_one();
+    {
+        std::unique_lock<std::mutex> lock(this->flushed_mutex);
+        this->flushed.wait(lock, [this, target]() { return this->written.load() >= target; });
+    }
+    this->flushing--;
+}
+
+bool Logger::drain_ready(uint64_t& head) {
+    // Only the drain thread reads slots, so head needs no atomics
+    Slot& slot = this->slots[head & (capacity - 1)];
+    if(slot.sequence.load(std::memory_order_acquire) != head + 1) {
+        return false;
+    }
+    std::ostream& console = slot.level == LogLevel::ERROR ? std::cerr : std::cout;
+    console << slot.line << '\n';
+    slot.line.clear();
+    slot.sequence.store(head + capacity, std::memory_order_release);
+    head++;
+    return true;
+}
+
+void Logger::drain_loop() {
+    uint64_t head = 0;
+    while(true) {
+        bool wrote = false;
+        while(this->drain_ready(head)) {
+            wrote = true;
+        }
+        if(wrote) {
+            // One flush per batch instead of one per line
+            std::cout.flush();
+            std::cerr.flush();
+            this->written.store(head);
+            if(this->flushing.load() > 0) {
+                // Taking the lock orders the store before a flusher's check of written
+                std::lock_guard<std::mutex> lock(this->flushed_mutex);
+                this->flushed.notify_all();
+            }
+            continue;
+        }
+        if(this->stopping.load(std::memory_order_acquire)) {
+            // Writers that claimed a slot before the stop finish filling it
+            if(head == this->tail.load(std::memory_order_acquire)) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        // Sleep until a writer sees the drain idle, the timeout covers a wake that raced the wait
+        std::unique_lock<std::mutex> lock(this->wake_mutex);
+        this->idle = true;
+        this->wake.wait_for(lock, std::chrono::milliseconds(10));
+        this->idle = false;
+    }
+}
+
+LogLine::LogLine(LogLevel level) {
+    this->level = level;
+}
+
+LogLine::~LogLine() {
+    if(currentLogCapture != nullptr) {
+        // A capture belongs to one thread, it is written directly
+        *currentLogCapture << this->text.str() << '\n';
+        return;
+    }
+    Logger::global().write(this->level, this->text.str());
+}
+
+std::ostream& LogLine::stream() {
+    return this->text;
+}
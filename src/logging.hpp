@@ -1,11 +1,34 @@
 #pragma once
 
 #include "magic_enum.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
 
 // Logging levels
 enum class LogLevel { DEBUG, INFO, WARNING, ERROR };
-static LogLevel currentLogLevel = LogLevel::DEBUG;
+
+// Calls below this level are removed at compile time, their arguments are never compiled into the
+// program. Release builds keep info and up unless the build says otherwise.
+#ifndef RAJ_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define RAJ_LOG_MIN_LEVEL 1
+#else
+#define RAJ_LOG_MIN_LEVEL 0
+#endif
+#endif
+constexpr LogLevel compiled_log_level = static_cast<LogLevel>(RAJ_LOG_MIN_LEVEL);
+
+// When set, log lines of the current thread are written here instead of the console. Lets the
+// parallel driver collect the diagnostics of each file and print them in file order.
+inline thread_local std::ostream* currentLogCapture = nullptr;
 
 // ANSI escape codes for colors
 constexpr char ANSI_RESET[]  = "\x1B[0m";
@@ -14,18 +37,82 @@ constexpr char ANSI_YELLOW[] = "\x1B[33m";
 constexpr char ANSI_GREEN[]  = "\x1B[32m";
 constexpr char ANSI_CYAN[]   = "\x1B[36m";
 
+class Logger {
+public:
+    // The one logger of the process. Console lines are put on a lock-free ring and written by a
+    // background thread, so a logging thread never waits on the terminal. Errors go to stderr,
+    // the rest to stdout, each in the order they were logged.
+    static Logger& global();
+    ~Logger();
+
+    // Level below which enabled calls are skipped at run time, shared by every translation unit
+    static void     set_level(LogLevel level);
+    static LogLevel level();
+    static bool     enabled(LogLevel level) {
+        return static_cast<int>(level) >= threshold.load(std::memory_order_relaxed);
+    }
+
+    // Queue a finished line for the console, waits only while the ring is full
+    void write(LogLevel level, std::string line);
+    // Return once every line written before the call is on the console
+    void flush();
+
+private:
+    class Slot {
+    public:
+        std::atomic<uint64_t> sequence;
+        LogLevel              level;
+        std::string           line;
+    };
+
+    static constexpr size_t capacity = 4096; // Power of two
+    static inline std::atomic<int> threshold{static_cast<int>(LogLevel::WARNING)};
+
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<uint64_t>   tail; // Next slot a writer claims
+    std::atomic<uint64_t>   written; // Lines the drain has put on the console
+    std::atomic<bool>       idle;
+    std::atomic<bool>       stopping;
+    std::atomic<uint32_t>   flushing; // Threads waiting in flush
+    std::mutex              wake_mutex; // Only for the drain to sleep on, writers never take it
+    std::condition_variable wake;
+    std::mutex              flushed_mutex; // Only taken while a thread waits in flush
+    std::condition_variable flushed;
+    std::thread             drain;
+
+    Logger();
+    void drain_loop();
+    bool drain_ready(uint64_t& head);
+};
+
+class LogLine {
+public:
+    // One line being formatted, handed to the capture of the thread or the logger when it ends
+    explicit LogLine(LogLevel level);
+    LogLine(const LogLine&)            = delete;
+    LogLine& operator=(const LogLine&) = delete;
+    ~LogLine();
+
+    std::ostream& stream();
+
+private:
+    LogLevel           level;
+    std::ostringstream text;
+};
+
+// The message is only formatted, and its arguments only evaluated, when the level is enabled
+#define LOG_AT(level, color, tag, msg)                                                             \
+    if constexpr(level < compiled_log_level) {}                                                    \
+    else if(!Logger::enabled(level)) {}                                                            \
+    else {                                                                                         \
+        LogLine raj_log_line(level);                                                               \
+        raj_log_line.stream() << color << tag << msg << ANSI_RESET;                                \
+    }
+
 // Macros for conditional logging with colors
-#define LOG_DEBUG(msg)                                                                             \
-    if(currentLogLevel <= LogLevel::DEBUG)                                                         \
-        std::cout << ANSI_GREEN << "[DEBUG] " << msg << ANSI_RESET << std::endl;
-#define LOG_INFO(msg)                                                                              \
-    if(currentLogLevel <= LogLevel::INFO)                                                          \
-        std::cout << ANSI_CYAN << "[INFO] " << msg << ANSI_RESET << std::endl;
-#define LOG_WARNING(msg)                                                                           \
-    if(currentLogLevel <= LogLevel::WARNING)                                                       \
-        std::cout << ANSI_YELLOW << "[WARNING] " << msg << ANSI_RESET << std::endl;
-#define LOG_ERROR(msg)                                                                             \
-    if(currentLogLevel <= LogLevel::ERROR)                                                         \
-        std::cerr << ANSI_RED << "[ERROR] " << msg << ANSI_RESET << std::endl;
-
-#define ename(em) magic_enum::enum_name(em)
\ No newline at end of file
+#define LOG_DEBUG(msg)   LOG_AT(LogLevel::DEBUG, ANSI_GREEN, "[DEBUG] ", msg)
+#define LOG_INFO(msg)    LOG_AT(LogLevel::INFO, ANSI_CYAN, "[INFO] ", msg)
+#define LOG_WARNING(msg) LOG_AT(LogLevel::WARNING, ANSI_YELLOW, "[WARNING] ", msg)
+#define LOG_ERROR(msg)   LOG_AT(LogLevel::ERROR, ANSI_RED, "[ERROR] ", msg)
+
+#define ename(em) magic_enum::enum_name(em)
@@ -1,45 +1,121 @@
-#include <algorithm>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <string>
+#include <vector>
 
 #include <CLI/CLI.hpp>
 #include <catch.hpp>
 #include <magic_enum_all.hpp>
 #include <magic_enum.hpp>
 
-#include "AST.hpp"
-#include "Lexer.hpp"
+#include "Allocation.hpp"
+#include "Compiler.hpp"
+#include "Parallel.hpp"
+#include "Profile.hpp"
 
 #include "logging.hpp"
 
-extern LogLevel currentLogLevel;
-
 int main(int argc, char** argv) {
-    CLI::App    app{"Raj Language Compiler"};
-    std::string file;
-    // TODO:: Pass file into the source_files vector
-    app.add_option("-f,--file", file, "Require a source file")->required()->check(CLI::ExistingFile);
+    CLI::App                 app{"Raj Language Compiler"};
+    std::vector<std::string> inputs;
+    CompilerOptions          options;
+    uint64_t                 cache_megabytes = 512;
+    std::string              log_level       = "warning";
+    bool                     time_report     = false;
+    bool                     alloc_report    = false;
+    std::filesystem::path    trace_path;
+    options.jobs = default_jobs();
+    app.add_option("-f,--file,files", inputs, "Source files or directories to compile, - for stdin")
+        ->required()
+        ->check(CLI::ExistingPath | CLI::IsMember({"-"}));
+    app.add_option("-j,--jobs", options.jobs, "Number of files compiled in parallel, defaults to the core count");
+    app.add_flag("--lazy",
+                 options.parse.lazy_bodies,
+                 "Only parse the bodies of functions reachable from main, errors in the others "
+                 "are not reported");
+    app.add_option("--cache-dir",
+                   options.cache_directory,
+                   "Keep the tokens and trees of unchanged files in this directory between runs");
+    app.add_option("--cache-size", cache_megabytes, "Size the cache is trimmed to in MiB");
+    app.add_option("--emit-ast",
+                   options.emit_format,
+                   "Write the AST of each file as graphviz (dot), json or the binary AST format "
+                   "(bin), by default next to the file")
+        ->check(CLI::IsMember({"dot", "json", "bin"}));
+    app.add_option("--emit-ast-path",
+                   options.emit_path,
+                   "File the AST is written to, or the directory for several source files");
+    app.add_option("--emit-ast-depth",
+                   options.dump.max_depth,
+                   "Levels of the tree written by dot and json, the rest is marked truncated");
+    app.add_option("--emit-ast-root",
+                   options.emit_root,
+                   "Only write the subtree of the first function with this name for dot and json");
+    app.add_option("--log-level", log_level, "Least severe messages printed")
+        ->check(CLI::IsMember({"debug", "info", "warning", "error"}));
+    app.add_flag("--time-report",
+                 time_report,
+                 "Print wall and CPU time, counts and throughput of every phase per file and in "
+                 "total");
+    app.add_option("--trace", trace_path, "Write the phases as a Chrome trace to this file");
+    app.add_flag("--alloc-report",
+                 alloc_report,
+                 "Print the allocations, bytes and peak live bytes of every phase");
     CLI11_PARSE(app, argc, argv);
 
-    currentLogLevel                                 = LogLevel::ERROR;
-    std::vector<std::filesystem::path> source_files = {"examples/function_calling.raj"};
-    std::vector<SourceCode>            raw_file     = read_raw_file(source_files);
-
-    for(const auto& file : raw_file) {
-        currentLogLevel                                   = LogLevel::ERROR;
-        std::vector<std::tuple<Lexeme, Location>> lexemes = lex_file(file);
-        lexemes                                           = filter_spaces(lexemes);
-        // Basic debugging
-        LOG_DEBUG("Lexemes Identified: ")
-        for(const auto& lex : lexemes) {
-            LOG_DEBUG(std::get<0>(lex).tokens + " " +
-                      std::string(magic_enum::enum_name(std::get<0>(lex).lexeme_type)))
+    // One level for every file of the process, the lexer and parser included
+    const std::map<std::string, LogLevel> log_levels = {{"debug", LogLevel::DEBUG},
+                                                        {"info", LogLevel::INFO},
+                                                        {"warning", LogLevel::WARNING},
+                                                        {"error", LogLevel::ERROR}};
+    Logger::set_level(log_levels.at(log_level));
+    if(time_report || !trace_path.empty()) {
+#if RAJ_PROFILING
+        Profiler::enable();
+#else
+        LOG_WARNING("This build has no phase probes, configure with RAJ_PROFILING to time phases")
+#endif
+    }
+    if(alloc_report) {
+        // The arenas of the trees draw from the counting resource
+        AllocationTracker::enable();
+        options.memory = AllocationTracker::resource();
+        if(!AllocationTracker::hooks_operator_new) {
+            LOG_WARNING("Only arena allocations are counted, configure with "
+                        "RAJ_ALLOCATION_TRACKING to count operator new")
         }
-        // Generate the AST for the lexemes
-        currentLogLevel = LogLevel::DEBUG;
-        generate_ast(lexemes);
     }
+    options.cache_bytes = cache_megabytes << 20;
 
-    return 0;
-}
\ No newline at end of file
+    // Diagnostics of each file are printed in the order the files were given
+    std::vector<std::filesystem::path> files = collect_source_files(inputs);
+    if(files.empty()) {
+        LOG_ERROR("Nothing to compile, no source files were found")
+        return 1;
+    }
+    CompilerContext            context(options, std::cerr);
+    std::vector<CompileResult> results   = context.compile(files);
+    int                        exit_code = 0;
+    for(const CompileResult& result : results) {
+        if(!result.success) {
+            exit_code = 1;
+        }
+    }
+    if(time_report) {
+        Profiler::global().write_report(std::cerr);
+    }
+    if(alloc_report) {
+        AllocationTracker::write_report(std::cerr);
+    }
+    if(!trace_path.empty()) {
+        std::ofstream trace(trace_path);
+        Profiler::global().write_trace(trace);
+        if(!trace) {
+            LOG_ERROR("Unable to write the trace to " << trace_path)
+            exit_code = 1;
+        }
+    }
+    return exit_code;
+}
@@ -1,43 +1,262 @@
 #include <catch.hpp> // Include the Catch header
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
 
 // Include the header of the code you want to test
 #include "AST.hpp"
+#include "Allocation.hpp"
+#include "BinaryAST.hpp"
+#include "Cache.hpp"
+#include "Compiler.hpp"
+#include "Diagnostics.hpp"
+#include "Dump.hpp"
 #include "Lexer.hpp"
+#include "Profile.hpp"
+#include "Resolve.hpp"
+#include "Scan.hpp"
+#include "logging.hpp"
 
-std::vector<std::tuple<Lexeme, Location>> filtered_lexemes(std::string input) {
-    SourceCode sourceCode = SourceCode(std::filesystem::current_path(), input + " \n");
-    std::vector<std::tuple<Lexeme, Location>> lexemes = lex_file(sourceCode);
-    lexemes                                           = filter_spaces(lexemes);
-    return lexemes;
+TokenBuffer filtered_lexemes(std::string input) {
+    // Token buffers point into their source, keep every source alive for the whole test run
+    static std::deque<SourceCode> sources;
+    const SourceCode& sourceCode = sources.emplace_back(std::filesystem::current_path(), input);
+    return lex_file(sourceCode);
 }
 
 TEST_CASE("Test Case 01: Validate Tokenization") {
     std::string input = "func banana(x : i32) -> i32 { return x * x; }";
 
-    std::vector<std::tuple<Lexeme, Location>> lexemes = filtered_lexemes(input);
-    for(int i = 0; i < lexemes.size(); ++i) {
-        auto lexeme = lexemes[i];
-        LOG_DEBUG(std::get<0>(lexeme).tokens << " " << i);
+    TokenBuffer lexemes = filtered_lexemes(input);
+    for(size_t i = 0; i < lexemes.size(); ++i) {
+        LOG_DEBUG(lexemes.text(i) << " " << i);
     }
     REQUIRE(lexemes.size() == 16);
+    REQUIRE(lexemes.text(1) == "banana");
+    REQUIRE(lexemes.text(7) == "->");
+    REQUIRE(lexemes.location(7).line() == 1);
+    REQUIRE(lexemes.location(7).column() == 22);
+}
+
+TEST_CASE("Test Case 01b: Validate Lexeme Classes") {
+    std::string input = "let x : f32 = 4.2 * y; # comment";
+
+    TokenBuffer              lexemes  = filtered_lexemes(input);
+    std::vector<LexemeClass> expected = {
+        LexemeClass::Declaration,
+        LexemeClass::Identifier,
+        LexemeClass::Colon,
+        LexemeClass::FloatType,
+        LexemeClass::Assignment,
+        LexemeClass::FloatLiteral,
+        LexemeClass::MathExpression,
+        LexemeClass::Identifier,
+        LexemeClass::SemiColon,
+        LexemeClass::Comment,
+    };
+    REQUIRE(lexemes.size() == expected.size());
+    for(size_t i = 0; i < lexemes.size(); ++i) {
+        REQUIRE(lexemes.kind(i) == expected[i]);
+    }
+    REQUIRE(Lexeme("i64").lexeme_type == LexemeClass::IntegerType);
+    REQUIRE(Lexeme("u128").lexeme_type == LexemeClass::UIntegerType);
+    REQUIRE(Lexeme("map").lexeme_type == LexemeClass::Map);
+    REQUIRE(keyword_sub_type("i128") == ASTNodeSubType::i128);
+    REQUIRE(Lexeme("15").lexeme_type == LexemeClass::IntegerLiteral);
+    REQUIRE(Lexeme("12abc").lexeme_type == LexemeClass::Error);
+    REQUIRE(Lexeme(".abc").lexeme_type == LexemeClass::Error);
+    REQUIRE(Lexeme("1.5abc").lexeme_type == LexemeClass::Error);
+    REQUIRE(Lexeme("1e").lexeme_type == LexemeClass::Error);
+    REQUIRE(Lexeme("1.2.3").lexeme_type == LexemeClass::Error);
+    REQUIRE(Lexeme(".").lexeme_type == LexemeClass::Error);
+    REQUIRE(Lexeme("2e10").lexeme_type == LexemeClass::Error);
+    REQUIRE(Lexeme("1.5E3").lexeme_type == LexemeClass::Error);
+    REQUIRE(Lexeme(".5").lexeme_type == LexemeClass::FloatLiteral);
+    REQUIRE(Lexeme("1.").lexeme_type == LexemeClass::FloatLiteral);
+}
+
+TEST_CASE("Test Case 01c: Memory Mapped Sources") {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "raj_test_01c.raj";
+    {
+        std::ofstream out(path);
+        out << "let x : i32 = 4;"; // No trailing newline
+    }
+    std::vector<SourceCode> sources = read_raw_file({path});
+    REQUIRE(sources.size() == 1);
+    REQUIRE(sources[0].is_mapped());
+    REQUIRE(sources[0].raw_document == "let x : i32 = 4;");
+
+    TokenBuffer lexemes = lex_file(sources[0]);
+    REQUIRE(lexemes.size() == 7);
+    REQUIRE(lexemes.kind(6) == LexemeClass::SemiColon);
+
+    // Rereading unchanged content reuses the file id, changed content gets a new one and
+    // locations into the old content still resolve against its own lines
+    Location semicolon = lexemes.location(6);
+    REQUIRE(read_raw_file({path})[0].file_id == sources[0].file_id);
+    {
+        std::ofstream out(path);
+        out << "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n";
+    }
+    std::vector<SourceCode> changed = read_raw_file({path});
+    REQUIRE(changed[0].file_id != sources[0].file_id);
+    REQUIRE(Location(changed[0].file_id, 15).line() == 16);
+    REQUIRE(semicolon.line() == 1);
+    REQUIRE(semicolon.column() == 16);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Test Case 01d: Chunked Parallel Lexing") {
+    std::string input;
+    for(int i = 0; i < 50; i++) {
+        input += "func f(x : i32) -> i32 { # comment\n    return (x * x) + 4.2;\n}\n\n";
+    }
+    SourceCode source(std::filesystem::current_path(), input);
+    for(bool keep_spaces : {false, true}) {
+        TokenBuffer serial = lex_file(source, keep_spaces);
+        for(size_t min_chunk_size : {1, 7, 100}) {
+            TokenBuffer chunked = lex_file_parallel(source, 4, keep_spaces, min_chunk_size);
+            REQUIRE(chunked.kinds == serial.kinds);
+            REQUIRE(chunked.offsets == serial.offsets);
+            REQUIRE(chunked.lengths == serial.lengths);
+            REQUIRE(chunked.symbols == serial.symbols);
+        }
+    }
+
+    // Chunks that are nothing but whitespace, and names first interned by the chunks
+    std::string blank = "let a : i32 = 1;\n" + std::string(64, '\n') + "  let b : i32 = a;\n\n";
+    SourceCode  blank_source(std::filesystem::current_path(), blank + blank + "let c");
+    std::ostringstream     sink;
+    CompilerContext        context(CompilerOptions(), sink);
+    CompilerContext::Scope scope(context);
+    for(bool keep_spaces : {false, true}) {
+        TokenBuffer chunked = lex_file_parallel(blank_source, 4, keep_spaces, 8);
+        TokenBuffer serial  = lex_file(blank_source, keep_spaces);
+        REQUIRE(chunked.kinds == serial.kinds);
+        REQUIRE(chunked.offsets == serial.offsets);
+        REQUIRE(chunked.lengths == serial.lengths);
+        REQUIRE(chunked.symbols == serial.symbols);
+    }
+    REQUIRE(context.symbols().size() == 3);
+}
+
+TEST_CASE("Test Case 01e: Streaming Tokens") {
+    std::string input = "func f(x : i32) -> i32 { # comment\n    return x*-4.2;\n}";
+    SourceCode  source(std::filesystem::current_path(), input);
+    TokenBuffer lexemes = lex_file(source);
+
+    Lexer       lexer(source);
+    TokenStream stream(lexer);
+    REQUIRE(stream.peek(2).lexeme_type == LexemeClass::ParenL);
+    for(size_t i = 0; i < lexemes.size(); i++) {
+        REQUIRE(stream.location().offset == lexemes.offsets[i]);
+        REQUIRE(stream.next() == lexemes[i]);
+    }
+    REQUIRE(stream.at_end());
+    REQUIRE(stream.next().lexeme_type == LexemeClass::EndOfInput);
+    REQUIRE(stream.peek(TokenStream::lookahead - 1).lexeme_type == LexemeClass::EndOfInput);
+}
+
+TEST_CASE("Test Case 01f: Vectorised Scanning") {
+    std::string input;
+    for(int i = 0; i < 40; i++) {
+        input += "# a comment long enough to span several blocks of the scanner\n";
+        input += "let identifier_" + std::to_string(i) + " : f64 = 1234567890123.5;\t\r\n\n";
+    }
+    SourceCode source(std::filesystem::current_path(), input);
+
+    ScanLevel detected = detect_scan_level();
+    set_scan_level(ScanLevel::Scalar);
+    TokenBuffer scalar = lex_file(source, true);
+    for(ScanLevel level : {ScanLevel::SSE2, ScanLevel::AVX2}) {
+        // Levels this CPU lacks fall back to the best it has
+        set_scan_level(level);
+        TokenBuffer vectorised = lex_file(source, true);
+        REQUIRE(vectorised.kinds == scalar.kinds);
+        REQUIRE(vectorised.offsets == scalar.offsets);
+        REQUIRE(vectorised.lengths == scalar.lengths);
+        REQUIRE(count_newlines(input) == 120);
+    }
+    set_scan_level(detected);
+
+    // The line index of the FileTable is built by the same kernels
+    REQUIRE(Location(source.file_id, input.length() - 1).line() == 120);
+    REQUIRE(scalar.location(4).line() == 2);
+    REQUIRE(scalar.location(4).column() == 5);
+}
+
+TEST_CASE("Test Case 01g: Interned Symbols") {
+    SymbolTable& symbols = SymbolTable::global();
+    Symbol       banana  = symbols.intern("banana");
+    REQUIRE(symbols.intern(std::string("bana") + "na") == banana);
+    REQUIRE(symbols.intern("bananas") != banana);
+    REQUIRE(symbols.name(banana) == "banana");
+    REQUIRE(Lexeme("banana").symbol == banana);
+    REQUIRE(Lexeme("i32").symbol == no_symbol);
+
+    // Files lexed on several threads share the pool, every name gets one symbol
+    std::vector<std::string> inputs(8);
+    for(size_t i = 0; i < inputs.size(); i++) {
+        for(int n = 0; n < 500; n++) {
+            inputs[i] += "let name_" + std::to_string((n * 7 + i) % 600) + " : i32 = banana;\n";
+        }
+    }
+    std::deque<SourceCode> sources;
+    for(const std::string& input : inputs) {
+        sources.emplace_back(std::filesystem::current_path(), input);
+    }
+    std::vector<TokenBuffer> buffers(inputs.size());
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < inputs.size(); i++) {
+        threads.emplace_back([&, i]() { buffers[i] = lex_file(sources[i]); });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    for(const TokenBuffer& buffer : buffers) {
+        for(size_t t = 0; t < buffer.size(); t++) {
+            if(buffer.kind(t) == LexemeClass::Identifier) {
+                REQUIRE(symbols.name(buffer.symbol(t)) == buffer.text(t));
+                REQUIRE(symbols.intern(buffer.text(t)) == buffer.symbol(t));
+            }
+            else {
+                REQUIRE(buffer.symbol(t) == no_symbol);
+            }
+        }
+    }
+    REQUIRE(buffers[0].symbol(5) == banana);
+
+    // AST nodes carry the symbol of the name they declare or use
+    SourceCode source(std::filesystem::current_path(), "func banana(x : i32) -> i32 { return x; }");
+    Tree       ast      = generate_ast(source);
+    vertex_t   function = ast.first_child(0);
+    vertex_t   argument = ast.first_child(function);
+    vertex_t   use      = ast.first_child(ast.next_sibling(ast.next_sibling(argument)));
+    REQUIRE(ast[function].symbol == banana);
+    REQUIRE(ast[use].node_class == ASTNodeClass::Identifier);
+    REQUIRE(ast[use].symbol == ast[argument].symbol);
 }
 
 TEST_CASE("Test Case 02: Validate Basic Types") {
     // i32
     // f64
 
-    Tree                                      tree;
-    vertex_t                                  root;
-    std::vector<std::tuple<Lexeme, Location>> lexemes;
-    Location                                  root_location = Location(0, 0, "Test Case 02");
+    Tree        tree;
+    vertex_t    root;
+    TokenBuffer lexemes;
+    Location    root_location = Location();
 
     // Subtest 1
     lexemes = filtered_lexemes("i32");
     std::cout << lexemes.size() << std::endl;
-    for(int i = 0; i < lexemes.size(); ++i) {
-        auto lexeme = lexemes[i];
-        LOG_DEBUG(std::get<0>(lexeme).tokens << " " << i);
+    for(size_t i = 0; i < lexemes.size(); ++i) {
+        LOG_DEBUG(lexemes.text(i) << " " << i);
     }
 
     auto tuple = parse_type(lexemes, root_location);
@@ -71,10 +290,10 @@ TEST_CASE("Test Case 03a: Validate Complex Types") {
     // func<i32, f32> -> f32
     // func<i32, f32> -> (i32, f32)
 
-    Tree                                      tree;
-    vertex_t                                  root;
-    std::vector<std::tuple<Lexeme, Location>> lexemes;
-    Location                                  root_location = Location(0, 0, "Test Case 02");
+    Tree        tree;
+    vertex_t    root;
+    TokenBuffer lexemes;
+    Location    root_location = Location();
 
     lexemes = filtered_lexemes("array<i32>");
 
@@ -98,7 +317,22 @@ TEST_CASE("Test Case 03a: Validate Complex Types") {
             REQUIRE(tree[vertex].sub_type == ASTNodeSubType::array);
         }
     }
-    draw_graph(tree);
+    std::ostringstream dot;
+    write_dot(tree, dot);
+    REQUIRE(dot.str().find("0 -> 1;") != std::string::npos);
+
+    lexemes = filtered_lexemes("func<i32, f32> -> (i32, array<f32>)");
+    tuple   = parse_type(lexemes, root_location);
+    tree    = std::get<0>(tuple);
+    root    = std::get<1>(tuple);
+
+    // The result comes first, then the parameters
+    REQUIRE(tree[root].sub_type == ASTNodeSubType::func);
+    vertex_t result = tree.first_child(root);
+    REQUIRE(tree[result].sub_type == ASTNodeSubType::tuple);
+    REQUIRE(tree[tree.next_sibling(result)].name == "i32");
+    REQUIRE(tree[tree.next_sibling(tree.next_sibling(result))].name == "f32");
+    REQUIRE(tree.size() == 7);
 
     // lexemes = filtered_lexemes("f64");
 
@@ -109,4 +343,891 @@ TEST_CASE("Test Case 03a: Validate Complex Types") {
     // REQUIRE(tree[root].node_class == ASTNodeClass::Type);
     // REQUIRE(tree[root].name == "f64");
     // REQUIRE(tree[root].sub_type == ASTNodeSubType::f64);
-}
\ No newline at end of file
+}
+TEST_CASE("Test Case 03b: Interned Types") {
+    auto type_of = [](std::string input) {
+        TokenBuffer lexemes = filtered_lexemes(input);
+        TokenStream stream(lexemes);
+        return parse_type(stream);
+    };
+    TypeTable& types = TypeTable::global();
+
+    REQUIRE(type_of("i32") == types.primitive(ASTNodeSubType::i32));
+    REQUIRE(type_of("map<i32, i32>") == type_of("map< i32 ,i32 >"));
+    REQUIRE(type_of("map<i32, i32>") != type_of("map<i32, i64>"));
+    REQUIRE(type_of("(i32, f64)") != type_of("(f64, i32)"));
+    REQUIRE(type_of("func<i32, f32> -> f32") == type_of("func<i32,f32>->f32"));
+    REQUIRE(type_of("func<i32, f32> -> f32") != type_of("func<i32> -> f32"));
+    REQUIRE(type_of("func<> -> ()") == types.func({}, types.tuple({})));
+    REQUIRE(type_of("array<array<i32>>") == types.array(types.array(types.primitive(i32))));
+    // Signed and unsigned booleans are distinct types like the wider integers
+    REQUIRE(type_of("u1") == types.primitive(ASTNodeSubType::u1));
+    REQUIRE(type_of("i1") != type_of("u1"));
+    REQUIRE(types.to_string(type_of("u1")) == "u1");
+
+    size_t interned = types.size();
+    TypeId complex  = type_of("(array<i32>, map<i32, func<u8> -> (i1, f64)>)");
+    REQUIRE(types.size() > interned);
+    interned = types.size();
+    REQUIRE(type_of("(array<i32>, map<i32, func<u8> -> (i1, f64)>)") == complex);
+    REQUIRE(types.size() == interned);
+    REQUIRE(types.to_string(complex) == "(array<i32>, map<i32, func<u8> -> (i1, f64)>)");
+    REQUIRE(types.kind(complex) == ASTNodeSubType::tuple);
+
+    REQUIRE(type_of("array<i32") == no_type);
+    REQUIRE(type_of("map<i32>") == no_type);
+    REQUIRE(type_of("func<i32>") == no_type);
+    REQUIRE(std::get<1>(parse_type(filtered_lexemes("i32 i32"), Location())) == no_vertex);
+}
+
+TEST_CASE("Test Case 04: Flat AST") {
+    std::string input = "func banana(x : i32, y : f64) -> i32 { return x; }";
+    SourceCode  source(std::filesystem::current_path(), input);
+    Tree        ast = generate_ast(source);
+
+    REQUIRE(ast.size() == 9);
+    vertex_t function = ast.first_child(0);
+    REQUIRE(ast[function].node_class == ASTNodeClass::Function);
+    REQUIRE(ast[function].name == "banana");
+    REQUIRE(ast.parent(function) == 0);
+    REQUIRE(ast.next_sibling(function) == no_vertex);
+
+    std::vector<std::string_view> children;
+    for(vertex_t child = ast.first_child(function); child != no_vertex;
+        child          = ast.next_sibling(child)) {
+        children.push_back(ast[child].name);
+    }
+    // Generated names are stored in the tree's arena and survive a copy
+    Tree copy = ast;
+    ast       = Tree();
+    REQUIRE(children == std::vector<std::string_view>{"x", "y", "i32", "return"});
+    REQUIRE(copy[copy.first_child(function)].name == "x");
+    REQUIRE(copy[copy.first_child(function)].type == TypeTable::global().primitive(i32));
+
+    // Several return values are a tuple type
+    SourceCode pair(std::filesystem::current_path(), "func f(a : array<i32>) -> (i32, f32) { }");
+    Tree       pair_ast = generate_ast(pair);
+    vertex_t   argument = pair_ast.first_child(pair_ast.first_child(0));
+    REQUIRE(pair_ast[argument].name == "a");
+    REQUIRE(pair_ast[pair_ast.first_child(argument)].name == "array<i32>");
+    REQUIRE(pair_ast[pair_ast.next_sibling(argument)].node_class == ASTNodeClass::Return);
+    REQUIRE(pair_ast[pair_ast.next_sibling(argument)].name == "(i32, f32)");
+}
+
+TEST_CASE("Test Case 05: Expressions") {
+    std::string input = "func f(x : i32) -> (i32, f32) {\n"
+                        "    let (a, b) : (i32, f32) = (x + 2 * -x % 3, x as f32);\n"
+                        "    let g : func<i32> -> i32 = func (y : i32) -> i32 { return y; };\n"
+                        "    let m : map<i32, i32> = [1 : 2, 3 : 4]; # comment\n"
+                        "    a = g(a - 1 - 2)(b);\n"
+                        "    return (a, b);\n"
+                        "}";
+    SourceCode  source(std::filesystem::current_path(), input);
+    Tree        ast = generate_ast(source);
+
+    // Spell the tree out as nested calls, e.g. +(a, b), to check its shape
+    std::function<std::string(vertex_t)> spell = [&](vertex_t vertex) {
+        std::string text(ast[vertex].name);
+        if(ast.first_child(vertex) != no_vertex) {
+            text += "(";
+            for(vertex_t child = ast.first_child(vertex); child != no_vertex;
+                child          = ast.next_sibling(child)) {
+                text += spell(child) + (ast.next_sibling(child) == no_vertex ? ")" : ", ");
+            }
+        }
+        return text;
+    };
+    std::vector<std::string> statements;
+    vertex_t                 function = ast.first_child(0);
+    for(vertex_t child = ast.first_child(function); child != no_vertex;
+        child          = ast.next_sibling(child)) {
+        statements.push_back(spell(child));
+    }
+    REQUIRE(statements.size() == 7);
+    REQUIRE(statements[2] == "(a, b)(a, b, tuple(+(x, %(*(2, -(x)), 3)), as f32(x)))");
+    // Anonymous functions are named after the file, line and column
+    REQUIRE(statements[3].find("_332(y(i32), i32, return(y)))") != std::string::npos);
+    REQUIRE(statements[4] == "m(map(:(1, 2), :(3, 4)))");
+    REQUIRE(statements[5] == "=(a, call(g(g, -(-(a, 1), 2)), b))");
+    REQUIRE(statements[6] == "return(tuple(a, b))");
+
+    TypeTable& types       = TypeTable::global();
+    vertex_t   declaration = ast.next_sibling(ast.next_sibling(ast.first_child(function)));
+    REQUIRE(ast[declaration].type == types.tuple({types.primitive(i32), types.primitive(f32)}));
+    REQUIRE(ast[ast.first_child(declaration)].type == types.primitive(i32));
+    REQUIRE(ast[function].type == types.func({types.primitive(i32)}, ast[declaration].type));
+
+    auto errors = [](std::string text) {
+        SourceCode  source(std::filesystem::current_path(), text);
+        Diagnostics diagnostics;
+        currentDiagnostics = &diagnostics;
+        Tree ast           = generate_ast(source);
+        currentDiagnostics = nullptr;
+        return diagnostics.error_count();
+    };
+    REQUIRE(errors("func f() { let x : i32 = 1 + ; }") == 1);
+    REQUIRE(errors("func f() { let (x, y) : (i32, i32, i32) = g(); }") == 1);
+    REQUIRE(errors("func f() { let x : i32 = [1 : 2, 3]; }") == 1);
+    REQUIRE(errors("func f() { return 1 }") == 1);
+    REQUIRE(errors("func f() { ") == 1);
+    REQUIRE(errors("}") == 1);
+}
+
+TEST_CASE("Test Case 06: Name Resolution") {
+    std::string input = "func add(x : i32, y : i32) -> i32 { return x + y; }\n"
+                        "func main() {\n"
+                        "    let a : i32 = twice(1);\n"
+                        "    func twice(x : i32) -> i32 { return add(x, x); }\n"
+                        "    let (b, c) : (i32, i32) = (a, add(a, a));\n"
+                        "    {\n"
+                        "        let a : i32 = a + b;\n"
+                        "        print(a);\n"
+                        "    }\n"
+                        "    let f : func<i32> -> i32 = func (a : i32) -> i32 { return a * c; };\n"
+                        "    print(f(a));\n"
+                        "}";
+    SourceCode  source(std::filesystem::current_path(), input);
+    Tree        ast = generate_ast(source);
+
+    // Find nodes by class and name in source order
+    auto find = [&](ASTNodeClass node_class, std::string_view name, size_t nth = 0) {
+        for(vertex_t vertex : ast.vertex_set()) {
+            if(ast[vertex].node_class == node_class && ast[vertex].name == name && nth-- == 0) {
+                return vertex;
+            }
+        }
+        return no_vertex;
+    };
+    vertex_t add   = find(ASTNodeClass::Function, "add");
+    vertex_t twice = find(ASTNodeClass::Function, "twice");
+    vertex_t outer = find(ASTNodeClass::Declaration, "a", 0);
+    vertex_t inner = find(ASTNodeClass::Declaration, "a", 1);
+    vertex_t b     = find(ASTNodeClass::Declaration, "b");
+    vertex_t c     = find(ASTNodeClass::Declaration, "c");
+    vertex_t f     = find(ASTNodeClass::Declaration, "f");
+    REQUIRE(inner != no_vertex);
+
+    // Functions are visible before they are declared, calls bind to them
+    REQUIRE(ast.declaration(find(ASTNodeClass::Call, "twice")) == twice);
+    REQUIRE(ast.declaration(find(ASTNodeClass::Call, "add", 0)) == add);
+    REQUIRE(ast.declaration(find(ASTNodeClass::Identifier, "add", 1)) == add);
+    // Arguments of each function are its own
+    REQUIRE(ast.declaration(find(ASTNodeClass::Identifier, "x", 0)) == ast.first_child(add));
+    REQUIRE(ast.declaration(find(ASTNodeClass::Identifier, "x", 2)) == ast.first_child(twice));
+    // Destructured names, then shadowing where let a = a + b reads the outer a
+    REQUIRE(ast.declaration(find(ASTNodeClass::Identifier, "a", 0)) == outer);
+    REQUIRE(ast.declaration(find(ASTNodeClass::Identifier, "a", 3)) == outer);
+    REQUIRE(ast.declaration(find(ASTNodeClass::Identifier, "b", 0)) == b);
+    REQUIRE(ast.declaration(find(ASTNodeClass::Identifier, "a", 4)) == inner);
+    // The anonymous function sees its own argument and the enclosing c, f(a) is the outer a again
+    REQUIRE(ast[ast.declaration(find(ASTNodeClass::Identifier, "a", 5))].node_class ==
+            ASTNodeClass::Argument);
+    REQUIRE(ast.declaration(find(ASTNodeClass::Identifier, "c", 0)) == c);
+    REQUIRE(ast.declaration(find(ASTNodeClass::Call, "f")) == f);
+    REQUIRE(ast.declaration(find(ASTNodeClass::Identifier, "a", 6)) == outer);
+    // Nothing declares print
+    REQUIRE(ast.declaration(find(ASTNodeClass::Call, "print")) == no_vertex);
+
+    ScopeTree scopes = resolve_names(ast);
+    REQUIRE(scopes.scopes.size() == 6);
+    REQUIRE(scopes.lookup(0, SymbolTable::global().intern("add")) == add);
+    REQUIRE(scopes.lookup(0, SymbolTable::global().intern("twice")) == no_vertex);
+
+    // Thousands of locals in deeply nested scopes
+    std::string deep = "func g() {";
+    for(int i = 0; i < 3000; i++) {
+        deep += " let v" + std::to_string(i) + " : i32 = v" + std::to_string(i / 2) + ";";
+        if(i % 100 == 0) {
+            deep += " {";
+        }
+    }
+    deep += std::string(30, '}') + " }";
+    SourceCode deep_source(std::filesystem::current_path(), deep);
+    Tree       deep_ast = generate_ast(deep_source);
+    size_t     resolved = 0;
+    for(vertex_t vertex : deep_ast.vertex_set()) {
+        if(deep_ast[vertex].node_class == ASTNodeClass::Identifier) {
+            vertex_t declaration = deep_ast.declaration(vertex);
+            resolved += declaration != no_vertex;
+            if(declaration != no_vertex) {
+                REQUIRE(deep_ast[declaration].symbol == deep_ast[vertex].symbol);
+            }
+        }
+    }
+    // v0 = v0 is the only use before its declaration
+    REQUIRE(resolved == 2999);
+}
+
+TEST_CASE("Test Case 07: Lazy Function Bodies") {
+    std::string input = "func add(x : i32, y : i32) -> i32 { return x + y; }\n"
+                        "func unused(x : i32) -> i32 {\n"
+                        "    # a brace } in a comment\n"
+                        "    { let z : i32 = x * x; }\n"
+                        "    return unused(x - 1);\n"
+                        "}\n"
+                        "let limit : i32 = 3;\n"
+                        "func main() {\n"
+                        "    func twice(x : i32) -> i32 { return add(x, x) + limit; }\n"
+                        "    print(twice(1));\n"
+                        "}";
+    SourceCode   source(std::filesystem::current_path(), input);
+    ParseOptions lazy;
+    lazy.lazy_bodies = true;
+    Tree eager       = generate_ast(source);
+    Tree ast         = generate_ast(source, lazy);
+
+    std::function<std::string(const Tree&, vertex_t)> spell = [&](const Tree& tree,
+                                                                   vertex_t    vertex) {
+        std::string text(tree[vertex].name);
+        if(tree.first_child(vertex) != no_vertex) {
+            text += "(";
+            for(vertex_t child = tree.first_child(vertex); child != no_vertex;
+                child          = tree.next_sibling(child)) {
+                text += spell(tree, child) + (tree.next_sibling(child) == no_vertex ? ")" : ", ");
+            }
+        }
+        return text;
+    };
+    auto function = [](const Tree& tree, std::string_view name) {
+        for(vertex_t child = tree.first_child(0); child != no_vertex;
+            child          = tree.next_sibling(child)) {
+            if(tree[child].name == name) {
+                return child;
+            }
+        }
+        return no_vertex;
+    };
+
+    // Only signatures, the body of each top level function is skipped
+    REQUIRE(ast.unparsed_bodies.size() == 3);
+    REQUIRE(spell(ast, function(ast, "add")) == "add(x(i32), y(i32), i32)");
+    REQUIRE(spell(ast, function(ast, "main")) == "main(void)");
+    REQUIRE(ast[function(ast, "unused")].type == eager[function(eager, "unused")].type);
+    REQUIRE(spell(ast, function(ast, "limit")) == spell(eager, function(eager, "limit")));
+    REQUIRE(ast.size() < eager.size() / 2);
+
+    // What main uses is parsed on demand, nothing calls unused
+    parse_reachable(ast, function(ast, "main"));
+    REQUIRE(ast.body_parsed(function(ast, "main")));
+    REQUIRE(ast.body_parsed(function(ast, "add")));
+    REQUIRE_FALSE(ast.body_parsed(function(ast, "unused")));
+    parse_body(ast, function(ast, "unused"));
+    REQUIRE(ast.unparsed_bodies.empty());
+
+    // Once every body is parsed the tree matches the eager one, names resolve to the same places
+    for(std::string_view name : {"add", "unused", "limit", "main"}) {
+        REQUIRE(spell(ast, function(ast, name)) == spell(eager, function(eager, name)));
+    }
+    REQUIRE(ast.size() == eager.size());
+    auto bindings = [](const Tree& tree) {
+        std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> found;
+        for(vertex_t vertex : tree.vertex_set()) {
+            vertex_t declaration = tree.declaration(vertex);
+            if(declaration != no_vertex) {
+                found.emplace_back(tree[vertex].location.offset,
+                                   tree[vertex].node_class,
+                                   tree[declaration].location.offset);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    };
+    REQUIRE(bindings(ast) == bindings(eager));
+    REQUIRE(bindings(ast).size() == 14);
+
+    // A lexed buffer skips the same bodies
+    TokenBuffer lexemes  = lex_file(source);
+    Tree        buffered = generate_ast(lexemes, lazy);
+    REQUIRE(buffered.size() == generate_ast(source, lazy).size());
+    parse_reachable(buffered, function(buffered, "main"));
+    REQUIRE(spell(buffered, function(buffered, "main")) == spell(eager, function(eager, "main")));
+
+    SourceCode  unbalanced(std::filesystem::current_path(), "func f() { { }");
+    Diagnostics diagnostics;
+    currentDiagnostics = &diagnostics;
+    Tree skipped       = generate_ast(unbalanced, lazy);
+    currentDiagnostics = nullptr;
+    REQUIRE(diagnostics.error_count() == 1);
+    REQUIRE(skipped.first_child(0) == no_vertex);
+}
+
+TEST_CASE("Test Case 08: Parse Cache") {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "raj_cache_test";
+    std::filesystem::remove_all(directory);
+    ParseCache cache(directory, 1 << 20);
+
+    std::string  input = "func add(x : i32, y : i32) -> (i32, array<f32>) {\n"
+                         "    let m : map<i32, i32> = [1 : 2]; # comment\n"
+                         "    return (x + y, [1.5]);\n"
+                         "}\n"
+                         "func main() { print(add(1, 2)); { let z : i32 = 3; } }";
+    SourceCode   source(std::filesystem::current_path(), input);
+    ParseOptions options;
+    TokenBuffer  lexemes = lex_file(source);
+    Tree         ast     = generate_ast(lexemes, options);
+
+    TokenBuffer cached_lexemes;
+    Tree        cached;
+    REQUIRE_FALSE(cache.load(source, options, cached_lexemes, cached));
+    cache.store(source, options, lexemes, ast);
+    REQUIRE(cache.load(source, options, cached_lexemes, cached));
+    REQUIRE(cache.hits() == 1);
+    REQUIRE(cache.misses() == 1);
+
+    // Tokens and the tree come back exactly
+    REQUIRE(cached_lexemes.kinds == lexemes.kinds);
+    REQUIRE(cached_lexemes.offsets == lexemes.offsets);
+    REQUIRE(cached_lexemes.symbols == lexemes.symbols);
+    REQUIRE(cached.size() == ast.size());
+    for(vertex_t vertex : ast.vertex_set()) {
+        REQUIRE(cached[vertex].node_class == ast[vertex].node_class);
+        REQUIRE(cached[vertex].sub_type == ast[vertex].sub_type);
+        REQUIRE(cached[vertex].name == ast[vertex].name);
+        REQUIRE(cached[vertex].type == ast[vertex].type);
+        REQUIRE(cached[vertex].symbol == ast[vertex].symbol);
+        REQUIRE(cached[vertex].location.offset == ast[vertex].location.offset);
+        REQUIRE(cached.parent(vertex) == ast.parent(vertex));
+        REQUIRE(cached.first_child(vertex) == ast.first_child(vertex));
+        REQUIRE(cached.next_sibling(vertex) == ast.next_sibling(vertex));
+        REQUIRE(cached.declaration(vertex) == ast.declaration(vertex));
+    }
+
+    // A lazy tree keeps its skipped bodies, other options and other contents are other entries
+    ParseOptions lazy;
+    lazy.lazy_bodies = true;
+    REQUIRE(ParseCache::key(source, lazy) != ParseCache::key(source, options));
+    REQUIRE_FALSE(cache.load(source, lazy, cached_lexemes, cached));
+    cache.store(source, lazy, lexemes, generate_ast(lexemes, lazy));
+    REQUIRE(cache.load(source, lazy, cached_lexemes, cached));
+    REQUIRE(cached.unparsed_bodies.size() == 2);
+    parse_body(cached, cached.first_child(0));
+    REQUIRE(cached.body_parsed(cached.first_child(0)));
+    SourceCode changed(std::filesystem::current_path(), input + " ");
+    REQUIRE_FALSE(cache.load(changed, options, cached_lexemes, cached));
+
+    // An entry under the key of another source of the same length, as a hash collision would
+    // leave it, is a miss
+    std::string same_length = input;
+    same_length.back()      = ' ';
+    SourceCode colliding(std::filesystem::current_path(), same_length);
+    char       colliding_name[17];
+    std::snprintf(colliding_name,
+                  sizeof(colliding_name),
+                  "%016llx",
+                  static_cast<unsigned long long>(ParseCache::key(colliding, options)));
+    {
+        std::string   data = serialize_ast(ast, ParseCache::key(colliding, options), &lexemes);
+        std::ofstream out(directory / (std::string(colliding_name) + ".rajc"), std::ios::binary);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    REQUIRE_FALSE(cache.load(colliding, options, cached_lexemes, cached));
+
+    // Damaged entries are misses
+    for(const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::filesystem::resize_file(entry.path(), std::filesystem::file_size(entry.path()) / 2);
+    }
+    REQUIRE_FALSE(cache.load(source, options, cached_lexemes, cached));
+
+    // Eviction keeps the most recently used entries that fit
+    cache.store(source, options, lexemes, ast);
+    std::filesystem::path kept;
+    for(const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if(ParseCache::key(source, options) ==
+           std::stoull(entry.path().stem().string(), nullptr, 16)) {
+            kept = entry.path();
+        }
+        else {
+            auto used = std::filesystem::last_write_time(entry.path());
+            std::filesystem::last_write_time(entry.path(), used - std::chrono::hours(1));
+        }
+    }
+    ParseCache small(directory, std::filesystem::file_size(kept));
+    small.evict();
+    REQUIRE(std::distance(std::filesystem::directory_iterator(directory),
+                          std::filesystem::directory_iterator()) == 1);
+    REQUIRE(small.load(source, options, cached_lexemes, cached));
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Test Case 09: Binary AST") {
+    std::string input = "func add(x : i32, y : i32) -> (i32, array<f32>) {\n"
+                        "    let f : func<i32> -> map<i32, f32> =\n"
+                        "        func (a : i32) -> i32 { return a; };\n"
+                        "    return (x + y, [1.5]);\n"
+                        "}\n"
+                        "func main() { print(add(1, 2)); }";
+    SourceCode  source(std::filesystem::current_path(), input);
+    Tree        ast  = generate_ast(source);
+    std::string data = serialize_ast(ast, 42);
+
+    // Walked in place, names and types come from the file's own tables
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "raj_binary_ast.ast";
+    REQUIRE(emit_ast(ast, path));
+    {
+        MappedAst      file(path);
+        const AstView& view = file.view();
+        REQUIRE(view.validate());
+        REQUIRE(view.size() == ast.size());
+        REQUIRE(view.header().source_length == input.size());
+        REQUIRE(view.token_count() == 0);
+        for(vertex_t vertex : ast.vertex_set()) {
+            const AstFileNode& node = view.node(vertex);
+            REQUIRE(node.node_class == ast[vertex].node_class);
+            REQUIRE(view.name(vertex) == ast[vertex].name);
+            REQUIRE(node.offset == ast[vertex].location.offset);
+            REQUIRE(view.parent(vertex) == ast.parent(vertex));
+            REQUIRE(view.first_child(vertex) == ast.first_child(vertex));
+            REQUIRE(view.next_sibling(vertex) == ast.next_sibling(vertex));
+            REQUIRE(view.declaration(vertex) == ast.declaration(vertex));
+            if(ast[vertex].type != no_type) {
+                std::string spelled = TypeTable::global().to_string(ast[vertex].type);
+                REQUIRE(view.type_name(node.type) == spelled);
+            }
+            if(ast[vertex].symbol != no_symbol) {
+                REQUIRE(view.string(node.symbol) == SymbolTable::global().name(ast[vertex].symbol));
+            }
+        }
+    }
+    std::filesystem::remove(path);
+
+    // Loading gives back the tree and the tokens it was written with
+    TokenBuffer lexemes = lex_file(source);
+    data                = serialize_ast(ast, 42, &lexemes);
+    std::string aligned(data); // std::string storage is suitably aligned
+    AstView     view(aligned);
+    REQUIRE(view.validate());
+    TokenBuffer loaded_lexemes;
+    Tree        loaded = load_tree(view, source, loaded_lexemes);
+    REQUIRE(loaded.size() == ast.size());
+    REQUIRE(loaded_lexemes.kinds == lexemes.kinds);
+    REQUIRE(loaded_lexemes.symbols == lexemes.symbols);
+    for(vertex_t vertex : ast.vertex_set()) {
+        REQUIRE(loaded[vertex].name == ast[vertex].name);
+        REQUIRE(loaded[vertex].type == ast[vertex].type);
+        REQUIRE(loaded[vertex].symbol == ast[vertex].symbol);
+        REQUIRE(loaded.declaration(vertex) == ast.declaration(vertex));
+    }
+    // Names at their node's offset are views of the source rather than copies
+    size_t viewed = 0;
+    for(vertex_t vertex : loaded.vertex_set()) {
+        std::string_view name = loaded[vertex].name;
+        if(name == "x") {
+            REQUIRE(name.data() >= source.raw_document.data());
+            REQUIRE(name.data() < source.raw_document.data() + source.raw_document.length());
+            viewed++;
+        }
+    }
+    REQUIRE(viewed > 0);
+    SourceCode other(std::filesystem::current_path(), input + " ");
+    REQUIRE(load_tree(view, other, loaded_lexemes).size() == 0);
+
+    // Other versions and damaged files are refused
+    std::string newer(data);
+    newer[8] = static_cast<char>(ast_file_version + 1);
+    REQUIRE_FALSE(AstView(newer).validate());
+    REQUIRE(AstView(newer).damage() != nullptr);
+    REQUIRE_FALSE(AstView(std::string_view(data).substr(0, data.size() / 2)).validate());
+    REQUIRE_FALSE(AstView().validate());
+    std::string damaged(data);
+    auto        header = reinterpret_cast<const AstFileHeader*>(damaged.data());
+    std::memset(damaged.data() + header->parents.offset + 4, 0x7f, 4);
+    AstView damaged_view(damaged);
+    REQUIRE_FALSE(damaged_view.validate());
+    REQUIRE(damaged_view.damage() != nullptr);
+
+    // Links that are in range but inconsistent would make walks loop
+    auto link = [&data](std::string& copy, const AstFileSection& section, vertex_t vertex) {
+        return reinterpret_cast<uint32_t*>(copy.data() + section.offset) + vertex;
+    };
+    vertex_t first = ast.first_child(0);
+    std::string looped(data);
+    *link(looped, header->next_siblings, first) = first;
+    REQUIRE_FALSE(AstView(looped).validate());
+    std::string reparented(data);
+    *link(reparented, header->parents, first) = ast.next_sibling(first);
+    REQUIRE_FALSE(AstView(reparented).validate());
+    std::string cycle(data);
+    vertex_t    child = ast.first_child(first);
+    *link(cycle, header->parents, first)        = child;
+    *link(cycle, header->first_children, 0)     = ast.next_sibling(first);
+    *link(cycle, header->first_children, child) = first;
+    *link(cycle, header->last_children, child)  = first;
+    *link(cycle, header->next_siblings, first)  = no_vertex;
+    REQUIRE_FALSE(AstView(cycle).validate());
+}
+
+TEST_CASE("Test Case 10: AST Dumps") {
+    std::string input = "func add(x : i32, y : i32) -> i32 { return x + y; }\n"
+                        "func main() { print(add(1, 2)); }";
+    SourceCode  source(std::filesystem::current_path(), input);
+    Tree        ast = generate_ast(source);
+
+    // The whole tree, one node per line in dot
+    std::ostringstream dot;
+    write_dot(ast, dot);
+    std::string text = dot.str();
+    REQUIRE(text.rfind("digraph G {", 0) == 0);
+    REQUIRE(size_t(std::count(text.begin(), text.end(), '\n')) == 2 * ast.size() + 1);
+    REQUIRE(text.find("[label=\"add\"") != std::string::npos);
+
+    // Nested json, uses name their declaration
+    std::ostringstream json;
+    write_json(ast, json);
+    text = json.str();
+    REQUIRE(text.rfind("{\"id\":0,\"class\":\"Root\"", 0) == 0);
+    REQUIRE(text.find("\"name\":\"add\",\"line\":1,\"column\":1,\"type\":\"func<i32, i32> -> i32\"") !=
+            std::string::npos);
+    REQUIRE(text.find("\"declaration\":1") != std::string::npos);
+    REQUIRE(std::count(text.begin(), text.end(), '{') == static_cast<long>(ast.size()));
+
+    // Limits, a subtree cut below its first level
+    DumpOptions options;
+    options.root      = ast.first_child(0);
+    options.max_depth = 1;
+    std::ostringstream limited;
+    write_json(ast, limited, options);
+    text = limited.str();
+    long children = 0;
+    for(vertex_t child = ast.first_child(options.root); child != no_vertex;
+        child         = ast.next_sibling(child)) {
+        children++;
+    }
+    REQUIRE(std::count(text.begin(), text.end(), '{') == 1 + children);
+    REQUIRE(text.find("\"name\":\"main\"") == std::string::npos);
+    REQUIRE(text.find("\"truncated\":true") != std::string::npos);
+    options.root = static_cast<vertex_t>(ast.size());
+    REQUIRE_THROWS(write_dot(ast, limited, options));
+}
+
+TEST_CASE("Test Case 11: Process Wide Logging") {
+    // Levels set here reach the lexer, which is another translation unit
+    std::ostringstream captured;
+    currentLogCapture = &captured;
+    Logger::set_level(LogLevel::INFO);
+    SourceCode logged(std::filesystem::current_path(), "func main() {}");
+    REQUIRE(captured.str().find("[INFO] Initializing Source Code") != std::string::npos);
+
+    captured.str("");
+    Logger::set_level(LogLevel::WARNING);
+    SourceCode quiet(std::filesystem::current_path(), "func main() {}");
+    REQUIRE(captured.str().empty());
+
+    // Arguments of disabled calls are never evaluated
+    int evaluated = 0;
+    LOG_INFO("Evaluated " << ++evaluated)
+    REQUIRE(evaluated == 0);
+    LOG_WARNING("Evaluated " << ++evaluated)
+    REQUIRE(evaluated == 1);
+    REQUIRE(captured.str().find("[WARNING] Evaluated 1") != std::string::npos);
+    currentLogCapture = nullptr;
+
+}
+
+TEST_CASE("Test Case 12: Phase Profiling") {
+    std::string input = "func main() { let x : i32 = 1 + 2; }";
+    SourceCode  source("profiled.raj", input);
+    Profiler::enable();
+    size_t recorded = Profiler::global().events().size();
+    {
+        ProfileFile file(source.path);
+        TokenBuffer lexemes = lex_file(source);
+        Tree        ast     = generate_ast(lexemes);
+        REQUIRE(ast.size() > 1);
+    }
+
+    // One event per phase, attributed to the file and counting its work
+    std::vector<PhaseEvent> events = Profiler::global().events();
+    REQUIRE(events.size() == recorded + 2);
+    const PhaseEvent& lexed  = events[recorded];
+    const PhaseEvent& parsed = events[recorded + 1];
+    REQUIRE(std::string(lexed.phase) == "lex_file");
+    REQUIRE(lexed.file == "profiled.raj");
+    REQUIRE(lexed.counts.bytes == input.length());
+    REQUIRE(lexed.counts.tokens == parsed.counts.tokens);
+    REQUIRE(std::string(parsed.phase) == "generate_ast");
+    REQUIRE(parsed.counts.nodes > 1);
+    REQUIRE(parsed.start >= lexed.start + lexed.wall);
+
+    // Streamed, the tokens are counted as the parser pulls them from the lexer
+    {
+        ProfileFile file(source.path);
+        Tree        ast = generate_ast(source);
+    }
+    PhaseEvent streamed = Profiler::global().events()[recorded + 2];
+    REQUIRE(std::string(streamed.phase) == "generate_ast");
+    REQUIRE(streamed.counts.tokens == lexed.counts.tokens);
+
+    std::ostringstream trace;
+    Profiler::global().write_trace(trace);
+    REQUIRE(trace.str().rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+    REQUIRE(trace.str().find("\"name\":\"generate_ast\",\"cat\":\"raj\",\"ph\":\"X\"") !=
+            std::string::npos);
+    std::ostringstream report;
+    Profiler::global().write_report(report);
+    REQUIRE(report.str().find("(all files)") != std::string::npos);
+}
+
+TEST_CASE("Test Case 13: Allocation Tracking") {
+    AllocationTracker::enable();
+    auto phase_stats = [](const char* phase) {
+        for(const AllocationStats& stats : AllocationTracker::phases()) {
+            if(std::string(stats.phase) == phase) {
+                return stats;
+            }
+        }
+        return AllocationStats();
+    };
+    AllocationStats total = AllocationTracker::total();
+    {
+        // Arena blocks come from the counting resource and count towards the innermost probe
+        Arena arena(1024, AllocationTracker::resource());
+        {
+            PhaseProbe probe("allocation_test");
+            arena.allocate(100);
+            arena.allocate(2000);
+        }
+        // With operator new counted the arena's list of blocks is in the phase too
+        AllocationStats stats  = phase_stats("allocation_test");
+        uint64_t        blocks = 1024 + 2000 + alignof(std::max_align_t);
+        if(AllocationTracker::hooks_operator_new) {
+            REQUIRE(stats.count > 2);
+            REQUIRE(stats.bytes > blocks);
+            REQUIRE(stats.live > blocks);
+        }
+        else {
+            REQUIRE(stats.count == 2);
+            REQUIRE(stats.bytes == blocks);
+            REQUIRE(stats.live == blocks);
+        }
+        REQUIRE(stats.peak >= stats.live);
+        REQUIRE(AllocationTracker::total().count >= total.count + 2);
+    }
+    // Freed outside of the phase, still taken off the phase that allocated it
+    AllocationStats stats = phase_stats("allocation_test");
+    REQUIRE(stats.live == 0);
+    REQUIRE(stats.peak >= 1024 + 2000 + alignof(std::max_align_t));
+
+    std::ostringstream report;
+    AllocationTracker::write_report(report);
+    REQUIRE(report.str().find("allocation_test") != std::string::npos);
+    if(AllocationTracker::hooks_operator_new) {
+        // Global operator new counts as well
+        {
+            PhaseProbe       probe("allocation_new_test");
+            std::vector<int> numbers(1000);
+        }
+        REQUIRE(phase_stats("allocation_new_test").bytes == 1000 * sizeof(int));
+        REQUIRE(phase_stats("allocation_new_test").live == 0);
+    }
+}
+
+TEST_CASE("Test Case 14: Compiler Contexts") {
+    // Two contexts compiling at once share no tables, the process wide ones are left alone
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "raj_context_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    std::vector<std::filesystem::path> files;
+    for(const char* name : {"a.raj", "b.raj", "c.raj"}) {
+        files.push_back(directory / name);
+        std::ofstream(files.back()) << "func " << name[0] << "_function() -> i32 { return "
+                                    << name[0] << "_missing; }";
+    }
+    size_t             global_symbols = SymbolTable::global().size();
+    CompilerOptions    options;
+    options.jobs = 3;
+    std::ostringstream first_diagnostics;
+    std::ostringstream second_diagnostics;
+    CompilerContext    first(options, first_diagnostics);
+    CompilerContext    second(options, second_diagnostics);
+    std::vector<CompileResult> first_results;
+    std::vector<CompileResult> second_results;
+    std::thread first_thread([&]() { first_results = first.compile(files); });
+    std::thread second_thread([&]() { second_results = second.compile(files); });
+    first_thread.join();
+    second_thread.join();
+    REQUIRE(SymbolTable::global().size() == global_symbols);
+    REQUIRE(&first.symbols() != &second.symbols());
+    for(const std::vector<CompileResult>* results : {&first_results, &second_results}) {
+        REQUIRE(results->size() == files.size());
+        for(const CompileResult& result : *results) {
+            REQUIRE(result.success);
+        }
+    }
+    vertex_t function = first_results[1].ast.first_child(0);
+    REQUIRE(first.symbols().name(first_results[1].ast[function].symbol) == "b_function");
+
+    // Diagnostics reach the sink of their context in the order of the files
+    const std::string& text = first_diagnostics.str();
+    REQUIRE(text == second_diagnostics.str());
+    REQUIRE(text.find("a_missing") < text.find("b_missing"));
+    REQUIRE(text.find("b_missing") < text.find("c_missing"));
+    REQUIRE(text.find("c_missing") != std::string::npos);
+
+    // A context made after another one was destroyed may get its address, nothing of the old
+    // table is reused
+    for(int round = 0; round < 2; round++) {
+        std::ostringstream sink;
+        CompilerContext    context(options, sink);
+        CompileResult      result = context.compile(
+            SourceCode(std::filesystem::current_path(), "func recycled_name() {}"));
+        vertex_t function = result.ast.first_child(0);
+        REQUIRE(context.symbols().size() == 1);
+        REQUIRE(context.symbols().name(result.ast[function].symbol) == "recycled_name");
+    }
+
+    // A scope makes the tables of a context current on this thread
+    REQUIRE(&SymbolTable::current() == &SymbolTable::global());
+    {
+        CompilerContext::Scope scope(first);
+        REQUIRE(&SymbolTable::current() == &first.symbols());
+        REQUIRE(&TypeTable::current() == &first.types());
+    }
+    REQUIRE(&SymbolTable::current() == &SymbolTable::global());
+
+    // Sources in memory compile as well, failures are reported rather than thrown
+    CompileResult good =
+        first.compile(SourceCode(std::filesystem::current_path(), "func main() {}"));
+    REQUIRE(good.success);
+    CompileResult bad = first.compile(SourceCode(std::filesystem::current_path(), "func main( {"));
+    REQUIRE_FALSE(bad.success);
+    REQUIRE(first_diagnostics.str().find("[ERROR]") != std::string::npos);
+
+    // Files that cannot be read fail with a diagnostic in the file, the others still compile
+    std::ostringstream         unread_sink;
+    CompilerContext            unread(options, unread_sink);
+    std::vector<CompileResult> unread_results =
+        unread.compile({directory / "missing.raj", directory, files[0]});
+    REQUIRE(unread_results.size() == 3);
+    for(size_t i = 0; i < 2; i++) {
+        REQUIRE_FALSE(unread_results[i].success);
+        REQUIRE(unread_results[i].diagnostics.error_count() == 1);
+        REQUIRE(unread_results[i].diagnostics.errors()[0].location.file() ==
+                unread_results[i].source.path);
+    }
+    REQUIRE(unread_results[1].diagnostics.errors()[0].message.find("is a directory") !=
+            std::string::npos);
+    REQUIRE(unread_results[2].success);
+    REQUIRE(unread_sink.str().find("Unable to read " + (directory / "missing.raj").string()) !=
+            std::string::npos);
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Test Case 15: Error Recovery") {
+    // Text that is no lexeme becomes an Error token, the stream reports it and drops it
+    TokenBuffer lexemes = filtered_lexemes("let x : i32 = 1 @ 2;");
+    REQUIRE(lexemes.kind(6) == LexemeClass::Error);
+    REQUIRE(lexemes.text(6) == "@");
+
+    // Every error of the file is reported in one pass, parsing resumes after ; and before }
+    std::string input = "func f( {\n"
+                        "    let a : i32 = 1;\n"
+                        "}\n"
+                        "func g() -> i32 {\n"
+                        "    let x : i32 = 1 + ;\n"
+                        "    let y : array<i32 = 4;\n"
+                        "    let z : i32 = 5\n"
+                        "    return x\n"
+                        "}\n"
+                        "}\n"
+                        "func main() {\n"
+                        "    let w : i32 = 12abc;\n"
+                        "    g();\n"
+                        "}\n";
+    SourceCode  source(std::filesystem::current_path(), input);
+    Diagnostics diagnostics;
+    currentDiagnostics = &diagnostics;
+    Tree ast           = generate_ast(source);
+    currentDiagnostics = nullptr;
+    std::vector<size_t> lines;
+    for(const Diagnostic& diagnostic : diagnostics.errors()) {
+        lines.push_back(diagnostic.location.line());
+    }
+    REQUIRE(lines == std::vector<size_t>{1, 5, 6, 8, 9, 10, 12, 12});
+    REQUIRE(diagnostics.errors()[1].message ==
+            "Expected an expression, received ; of type SemiColon");
+    REQUIRE(diagnostics.errors()[6].message == "Unrecognized lexeme 12abc");
+
+    // The functions after an error are still in the tree, with the statements without errors
+    std::vector<std::string> functions;
+    for(vertex_t function = ast.first_child(0); function != no_vertex;
+        function          = ast.next_sibling(function)) {
+        functions.emplace_back(ast[function].name);
+    }
+    REQUIRE(functions == std::vector<std::string>{"g", "main"});
+    // Nothing of a statement with an error is kept, not even the vertices it made before the error
+    vertex_t main_function = ast.next_sibling(ast.first_child(0));
+    vertex_t call          = ast.next_sibling(ast.first_child(main_function));
+    REQUIRE(ast[call].node_class == ASTNodeClass::Call);
+    REQUIRE(ast.next_sibling(call) == no_vertex);
+    ParseOptions lazy;
+    lazy.lazy_bodies   = true;
+    currentDiagnostics = &diagnostics;
+    Tree lazy_ast      = generate_ast(source, lazy);
+    currentDiagnostics = nullptr;
+    for(const Tree* tree : {&ast, &lazy_ast}) {
+        for(vertex_t vertex = 1; vertex < tree->size(); vertex++) {
+            REQUIRE(tree->parent(vertex) != no_vertex);
+        }
+    }
+    REQUIRE(ast.declaration(call) == ast.first_child(0));
+
+    // Nesting past the limit is one error, the parse goes on after the statement it is in
+    auto nested = [](const char* lead, const char* open, const char* inner, const char* close) {
+        std::string text = std::string("func f() -> i32 { return ") + lead;
+        for(int i = 0; i < 300000; i++) {
+            text += open;
+        }
+        text += inner;
+        for(int i = 0; i < 300000; i++) {
+            text += close;
+        }
+        return text + "; }\nfunc g() {}";
+    };
+    std::vector<std::array<const char*, 4>> nestings = {
+        {"", "(", "1", ")"}, {"", "-", "1", ""}, {"", "[", "1", "]"}, {"1 as ", "array<", "i32", ">"}};
+    for(const auto& [lead, open, inner, close] : nestings) {
+        SourceCode  deep(std::filesystem::current_path(), nested(lead, open, inner, close));
+        Diagnostics deep_errors;
+        currentDiagnostics = &deep_errors;
+        Tree deep_ast      = generate_ast(deep);
+        currentDiagnostics = nullptr;
+        REQUIRE(deep_errors.error_count() == 1);
+        REQUIRE(deep_errors.errors()[0].message == "Nested more than 256 levels deep");
+        REQUIRE(deep_ast[deep_ast.next_sibling(deep_ast.first_child(0))].name == "g");
+    }
+    std::string blocks = "func f() {";
+    for(int i = 0; i < 300000; i++) {
+        blocks += "{";
+    }
+    for(int i = 0; i < 300000; i++) {
+        blocks += "}";
+    }
+    SourceCode  deep_blocks(std::filesystem::current_path(), blocks + "}\nfunc g() {}");
+    Diagnostics block_errors;
+    currentDiagnostics = &block_errors;
+    Tree block_ast     = generate_ast(deep_blocks);
+    currentDiagnostics = nullptr;
+    REQUIRE(block_errors.error_count() == 1);
+    REQUIRE(block_ast[block_ast.next_sibling(block_ast.first_child(0))].name == "g");
+
+    // Garbage stops the parse once the limit is reached, it is still counted
+    std::string garbage;
+    for(int i = 0; i < 1000; i++) {
+        garbage += "let ) ";
+    }
+    SourceCode  noise(std::filesystem::current_path(), garbage);
+    Diagnostics many;
+    currentDiagnostics = &many;
+    Tree partial       = generate_ast(noise);
+    currentDiagnostics = nullptr;
+    REQUIRE(many.limit_reached());
+    REQUIRE(many.errors().size() == Diagnostics::max_errors);
+
+    // A context hands the errors of each file back with its result
+    std::ostringstream sink;
+    CompilerContext    context(CompilerOptions(), sink);
+    CompileResult      result = context.compile(SourceCode(std::filesystem::current_path(), input));
+    REQUIRE_FALSE(result.success);
+    REQUIRE(result.diagnostics.error_count() == 8);
+    REQUIRE(sink.str().find("Unrecognized lexeme 12abc") != std::string::npos);
+}